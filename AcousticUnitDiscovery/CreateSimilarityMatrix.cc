@@ -19,21 +19,28 @@ int main(int argc, char* argv[])
 {
   if( argc < 3)
   {
-    std::cout<<"Usage is <HMM File> <alpha update>"<<std::endl;
+    std::cout<<"Usage is <HMM File> <alpha update> [Threads]"<<std::endl;
     exit(0);
   }
 
   std::string hmmfile = std::string(argv[1]);
   double alpha_update = utilities::ToNumber<double>( std::string(argv[2]) );
+  unsigned int threads = 0; // One per core.
+  if( argc > 3)
+    threads = utilities::ToNumber<unsigned int>( std::string(argv[3]) );
 
   statistics::HmmSet htk;
-  htk.LoadHtkHmmSet(hmmfile);
+  if(!htk.LoadHmmSet(hmmfile))
+  {
+    std::cout<<"File "<<hmmfile<<" could not be opened.\n";
+    exit(1);
+  }
   std::vector<statistics::MixtureOfDiagonalGaussians> mog = htk.states();
   std::vector<statistics::HiddenMarkovModel> hmmset = htk.hmms();
   statistics::PosteriorgramGenerator pg;                                         
 
   pg.SetGaussians(mog);
-  utilities::Matrix<double> sm = pg.ComputeSimilarityMatrix();
+  utilities::Matrix<double> sm = pg.ComputeSimilarityMatrix(threads);
 
   for(unsigned int h = 0; h < hmmset.size(); ++h)
   {
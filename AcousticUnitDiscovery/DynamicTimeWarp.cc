@@ -24,6 +24,79 @@ bool DynamicTimeWarp::ComputeSimilarityMatrix()
   return true;
 }
 
+// The norm of every frame is computed once, leaving only the sparse inner
+// product inside the double loop.
+bool DynamicTimeWarp::ComputeSimilarityMatrix(
+    const statistics::SparsePosteriorgram &one,
+    const statistics::SparsePosteriorgram &two)
+{
+  if(one.frames() < 1 || two.frames() < 1)
+    return false; // We must have two utterances.
+
+  std::vector<double> one_norm(one.frames()), two_norm(two.frames());
+  for(unsigned int first = 0; first < one.frames(); ++first)
+    one_norm[first] = one.Norm(first);
+  for(unsigned int second = 0; second < two.frames(); ++second)
+    two_norm[second] = two.Norm(second);
+
+  similarity_matrix_.Initialize(one.frames(), two.frames(), 0);
+  for(unsigned int first = 0; first < one.frames(); ++first)
+    for(unsigned int second = 0; second < two.frames(); ++second)
+    {
+      double distance = one.Dot(first, two, second) / 
+          (one_norm[first] * two_norm[second]);
+      similarity_matrix_(first, second) = 1 - ((distance + 1) / 2);
+    }
+  return true;
+}
+
+// Each utterance is expanded into a (frame x row) float buffer so the inner
+// product of two frames runs over contiguous memory.
+bool DynamicTimeWarp::ComputeSimilarityMatrix(
+    const statistics::QuantizedPosteriorgram &one,
+    const statistics::QuantizedPosteriorgram &two)
+{
+  if(one.frames() < 1 || two.frames() < 1 || one.rows() != two.rows())
+    return false; // We must have two utterances of the same dimension.
+
+  unsigned int rows = one.rows();
+  std::vector<float> one_values(static_cast<size_t>(one.frames()) * rows);
+  std::vector<float> two_values(static_cast<size_t>(two.frames()) * rows);
+  std::vector<double> one_norm(one.frames()), two_norm(two.frames());
+  for(unsigned int first = 0; first < one.frames(); ++first)
+  {
+    float *values = &one_values[static_cast<size_t>(first) * rows];
+    one.LinearFrame(first, values);
+    for(unsigned int i = 0; i < rows; ++i)
+      one_norm[first] += values[i] * values[i];
+    one_norm[first] = sqrt(one_norm[first]);
+  }
+  for(unsigned int second = 0; second < two.frames(); ++second)
+  {
+    float *values = &two_values[static_cast<size_t>(second) * rows];
+    two.LinearFrame(second, values);
+    for(unsigned int i = 0; i < rows; ++i)
+      two_norm[second] += values[i] * values[i];
+    two_norm[second] = sqrt(two_norm[second]);
+  }
+
+  similarity_matrix_.Initialize(one.frames(), two.frames(), 0);
+  for(unsigned int first = 0; first < one.frames(); ++first)
+  {
+    const float *a = &one_values[static_cast<size_t>(first) * rows];
+    for(unsigned int second = 0; second < two.frames(); ++second)
+    {
+      const float *b = &two_values[static_cast<size_t>(second) * rows];
+      double distance = 0;
+      for(unsigned int i = 0; i < rows; ++i)
+        distance += a[i] * b[i];
+      distance = distance / (one_norm[first] * two_norm[second]);
+      similarity_matrix_(first, second) = 1 - ((distance + 1) / 2);
+    }
+  }
+  return true;
+}
+
 bool DynamicTimeWarp::ComputeStandardDTW()
 {
   PathPoint start_point, end_point;
@@ -156,7 +229,7 @@ std::vector<double> DynamicTimeWarp::BestScorePerFrame()
 {
   std::vector<double> result;
   double max_value = 0;
-  result.resize(utterance_one_.NumRows(), 0);
+  result.resize(similarity_matrix_.NumRows(), 0);
   for(unsigned int i=0; i < paths_.size(); i++)
   {
     double total_score = paths_[i].total_score;
@@ -23,6 +23,8 @@
 
 #include "Matrix.h"
 #include "MatrixFunctions.h"
+#include "SparsePosteriorgram.h"
+#include "QuantizedPosteriorgram.h"
 #include "ImageIO.h" // Functions for writing the similarity matrix and paths
                      // as an image.
 
@@ -78,6 +80,18 @@ class DynamicTimeWarp
   // making calls to any of the path finding functions.
   bool ComputeSimilarityMatrix();
 
+  // Computes the similarity matrix directly from two sparse posteriorgrams,
+  // where one and two take the place of the stored utterances. The distance is
+  // the same as GetFeatureDistance with every posterior that is not stored
+  // treated as zero, so the result matches the dense posteriorgrams.
+  bool ComputeSimilarityMatrix(const statistics::SparsePosteriorgram &one,
+      const statistics::SparsePosteriorgram &two);
+
+  // Same as above for two quantized posteriorgrams or feature sets. Both are
+  // dequantized to linear values once before the distances are computed.
+  bool ComputeSimilarityMatrix(const statistics::QuantizedPosteriorgram &one,
+      const statistics::QuantizedPosteriorgram &two);
+
   // Computes the best path through the similarity matrix starting at point
   // [0][0] and ending at [length(utterance_one)][length(utterance_two)].  The 
   // computed path is added to the paths_ variable.
@@ -14,6 +14,7 @@
 #include "Matrix.h"
 #include "SpeechFeatures.h"
 #include "PosteriorgramGenerator.h"
+#include "MixtureSampler.h"
 #include "StringFunctions.h"
 #include "HmmSet.h"
 #include "MultiBestPath.h"
@@ -57,21 +58,6 @@ typedef struct
   unsigned int end; // Frame where the word ends.
 } WordLocation;
 
-std::vector<int> ReadVectorFromFile(std::string filename)
-{
-  std::vector<int> ret;
-  std::ifstream fin;
-  fin.open(filename.c_str(), std::ios::in);
-  while(fin.good())
-  {
-    double n;
-    fin >> n;
-    ret.push_back(static_cast<int>(n)-1);
-  }
-  ret.resize( ret.size() - 1 );
-  return ret;
-}
-
 std::vector<WordLocation> LoadLocationList( const std::string &location_file )
 {
   std::ifstream location_fin;
@@ -135,11 +121,7 @@ std::vector<utilities::Matrix<double> > LoadPosteriorgramData(
     utilities::Matrix<double> data = 
         sf.frames(0, locations[i].start, locations[i].end);
     data.Transpose();
-    utilities::Matrix<double> pgram = pg.ComputePosteriorgram(data);
-    for(unsigned int r = 0; r < pgram.NumRows(); ++r)
-      for(unsigned c = 0; c < pgram.NumCols(); ++c)
-        pgram(r,c) = std::log(pgram(r,c));
-    pgram_set.push_back(pgram);
+    pgram_set.push_back(pg.ComputeLogPosteriorgram(data));
   }
   return pgram_set;
 }
@@ -187,12 +169,14 @@ double ExpectedWordLength(
   return ret;
 }
 
-std::vector<std::vector<double> > GenerateSampleData( 
+// The state sequence is chosen first and then every frame is sampled in a
+// single call. Returns the data in (feature x frame) format.
+utilities::Matrix<double> GenerateSampleData( 
     std::vector<std::string> &triphone_pronunciation, statistics::HmmSet &htk,
-    std::vector<statistics::MixtureOfDiagonalGaussians> &mog,
+    const statistics::MixtureSampler &sampler,
     std::default_random_engine &generator, const PronunciationParameters &param)
 {
-  std::vector<std::vector<double> >ret;
+  std::vector<unsigned int> states;
   std::uniform_real_distribution<double> distribution(0.0,1.0);
   for(unsigned int p = 0; p < triphone_pronunciation.size(); ++p)
   {
@@ -208,8 +192,7 @@ std::vector<std::vector<double> > GenerateSampleData(
       {
         // Add frame only the first loop iteration because you must spend at
         // least one frame in each state.
-        std::vector<double> frame = mog[hmm.state(h)].Sample(generator);
-        ret.push_back(frame);
+        states.push_back(hmm.state(h));
         if( trans > hmm.transition(h+1, h+1) )
           ++h;
       }
@@ -217,12 +200,13 @@ std::vector<std::vector<double> > GenerateSampleData(
         ++h;
     }
   }
+  utilities::Matrix<double> ret;
+  sampler.Sample(states, generator, ret);
   return ret;
 }
 
 void AppendSampleData(std::vector<std::string> &triphone_pronunciation, 
-    statistics::HmmSet &htk, 
-    std::vector<statistics::MixtureOfDiagonalGaussians> &mog,
+    statistics::HmmSet &htk, const statistics::MixtureSampler &sampler,
     const statistics::PosteriorgramGenerator &pg,
     std::default_random_engine &generator, const PronunciationParameters &param,
     double mean_length, std::vector<utilities::Matrix<double> > &pgram_set)
@@ -234,21 +218,12 @@ void AppendSampleData(std::vector<std::string> &triphone_pronunciation,
         (attempts < (param.min_examples * param.attempts_per_example)) )
   {
     attempts++;
-    std::vector<std::vector<double> > data;
-    data = GenerateSampleData(triphone_pronunciation, htk, mog, 
+    utilities::Matrix<double> data;
+    data = GenerateSampleData(triphone_pronunciation, htk, sampler, 
         generator, param);
-    unsigned int frames = data.size();
+    unsigned int frames = data.NumCols();
     if( frames > min_length && frames < max_length)
-    {
-      utilities::Matrix<double> sample, pgram;
-      sample.Initialize(data);
-      sample.Transpose();
-      pgram = pg.ComputePosteriorgram(sample);
-      for(unsigned int r = 0; r < pgram.NumRows(); ++r)
-        for(unsigned c = 0; c < pgram.NumCols(); ++c)
-          pgram(r,c) = std::log(pgram(r,c));
-      pgram_set.push_back(pgram);
-    }
+      pgram_set.push_back(pg.ComputeLogPosteriorgram(data));
   }
 }
 
@@ -282,8 +257,7 @@ std::vector<int> GenerateClusteredPronunciation(
 
 std::vector<int> GenerateMogPronunciation(
     const std::vector<std::string> &triphone_pronunciation,
-    const statistics::HmmSet &htk, 
-    const std::vector<statistics::MixtureOfDiagonalGaussians> &mog,
+    const statistics::HmmSet &htk, const statistics::MixtureSampler &sampler,
     std::default_random_engine &generator, 
     const utilities::Matrix<double> &transition,
     const statistics::PosteriorgramGenerator &pg,
@@ -303,16 +277,13 @@ std::vector<int> GenerateMogPronunciation(
         param.total_clusters, 1);
   }
         
-  data.Initialize(param.dimension, triphone_pronunciation.size() * 3);
+  // One frame is sampled from every state of every HMM.
+  std::vector<unsigned int> states;
   for(unsigned int p = 0; p < triphone_pronunciation.size(); ++p)
   {
     statistics::HiddenMarkovModel hmm = htk.Hmm(triphone_pronunciation[p]);
     for(unsigned int h = 0; h < hmm.NumberOfStates(); ++h)
-    {
-      std::vector<double> sample = mog[hmm.state(h)].Sample(generator);
-      for(unsigned int m = 0; m < sample.size(); ++m)
-        data(m, (p*3)+h) = sample[m];
-    }
+      states.push_back(hmm.state(h));
     if( param.modify_transition )
     {
       for(unsigned int h = 0; h < hmm.NumberOfStates() - 1; ++h)
@@ -341,6 +312,7 @@ std::vector<int> GenerateMogPronunciation(
       }
     } // End if param.modify_transition
   } // End for triphone_pronunciation.size()
+  sampler.Sample(states, generator, data);
 
   if( param.modify_transition )
   {
@@ -350,10 +322,7 @@ std::vector<int> GenerateMogPronunciation(
             transition_count(r,c));
   }
   
-  utilities::Matrix<double> pgram = pg.ComputePosteriorgram(data);
-  for(unsigned int r = 0; r < pgram.NumRows(); ++r)
-    for(unsigned c = 0; c < pgram.NumCols(); ++c)
-      pgram(r,c) = std::log(pgram(r,c));
+  utilities::Matrix<double> pgram = pg.ComputeLogPosteriorgram(data);
 
   double final_score = 0;
   if( param.modify_transition )
@@ -395,17 +364,29 @@ int main(int argc, char* argv[])
   std::default_random_engine generator; // A single RNG.
 
   statistics::HmmSet htk;
-  htk.LoadHtkHmmSet(param.hmmfile);
+  if(!htk.LoadHmmSet(param.hmmfile))
+  {
+    std::cout<<"File "<<param.hmmfile<<" could not be opened.\n";
+    exit(1);
+  }
   std::vector<statistics::MixtureOfDiagonalGaussians> mog = htk.states();
   // Ugly way of initializing dimension, Find a better way!!!
   param.dimension = mog[0].gaussian(0).dimension();
   statistics::PosteriorgramGenerator pg;
   utilities::Matrix<double> transition;
-  std::vector<int> cluster_index = ReadVectorFromFile(param.cluster_file);
+  std::vector<int> cluster_index;
+  if(!utilities::ReadIndexFile(param.cluster_file, cluster_index))
+  {
+    std::cout<<"File "<<param.cluster_file<<" could not be read.\n";
+    exit(1);
+  }
   param.total_clusters = cluster_index.size();
   transition = acousticunitdiscovery::GenerateTransitionMatrix(
       param.total_clusters, param.self_transition);
   pg.SetGaussians(mog, cluster_index);
+  pg.AggregateClusters();
+  statistics::MixtureSampler sampler;
+  sampler.Initialize(mog);
   
   std::ifstream wordlist_fin;
   wordlist_fin.open(param.word_information.c_str());
@@ -457,7 +438,7 @@ int main(int argc, char* argv[])
           param.pronunciation_type == 1) // MOG
       {
         index_pronunciation = GenerateMogPronunciation( triphone_pronunciation,
-            htk, mog, generator, transition, pg, cluster_index, param);
+            htk, sampler, generator, transition, pg, cluster_index, param);
       }
       else if(locations.size() < param.min_examples &&
           param.pronunciation_type == 2) // HMM
@@ -476,8 +457,8 @@ int main(int argc, char* argv[])
             mean += (locations[i].end - locations[i].start + 1);
           mean = mean / locations.size();
         }
-        AppendSampleData(triphone_pronunciation, htk, mog, pg,generator, param, 
-            mean, pgram_set);
+        AppendSampleData(triphone_pronunciation, htk, sampler, pg, generator,
+            param, mean, pgram_set);
         index_pronunciation = acousticunitdiscovery::BestPathInSet(
             pgram_set, transition, param.min_frames);
 
@@ -111,123 +111,429 @@ std::vector<int> FindViterbiPath(const utilities::Matrix<double> &pgram,
 }
 
 // The number of states in the dynamic programming matrix is expanded by the 
-// minimum number of states required for each state. The logic to handle keeping
-// track of the indices has been handed off to the GetStateScore and 
-// GetTransitionScore functions. Note that the frequent use of std::max is to
-// protect against the -inf result from the log(0);
+// minimum number of states required for each state. Each column is computed by
+// ViterbiColumn and the logic to handle keeping track of the indices has been
+// handed off to the GetStateScore and GetTransitionScore functions. Note that
+// the frequent use of std::max is to protect against the -inf result from the
+// log(0);
 std::vector<int> FindRestrictedViterbiPath(
     const utilities::Matrix<double> &pgram,
     const utilities::Matrix<double> &transition, int min_frames, 
     std::vector<int> initial_path, bool force_align, double &final_score)
 {
-  std::vector<int> path; // Final path that we return.
   utilities::Matrix<ViterbiInfo> dp_matrix; // Holds the memoization data.
   unsigned int states = (pgram.NumRows() + initial_path.size()) * min_frames;
   unsigned int frames = pgram.NumCols();
+  std::vector<ViterbiInfo> column;
+  std::vector<double> previous(states);
+
+  // We initialize the the dp_matrix. Initially, every state is set with the
+  // minimum score and considered inaccessible.
+  ViterbiInfo default_value;
+  default_value.parent = -1;
+  default_value.score = -1000000;
+  dp_matrix.Initialize(states, frames, default_value);
+
+  // Fill in the dp_matrix one frame at a time. Only the scores of the previous
+  // frame are needed to compute the next column.
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    if(f == 0)
+      ViterbiInitialColumn(pgram, initial_path, min_frames, column);
+    else
+      ViterbiColumn(pgram, transition, min_frames, initial_path, f, previous,
+          column);
+    for(unsigned int s = 0; s < states; ++s)
+    {
+      dp_matrix(s, f) = column[s];
+      previous[s] = column[s].score;
+    }
+  }
+
+  // Set the final_score and return the best path.
+  return BestPathInDpMatrix(dp_matrix, min_frames, initial_path, force_align, 
+      final_score);
+}
+
+std::vector<int> FindViterbiPath(const statistics::SparsePosteriorgram &pgram,
+    const utilities::Matrix<double> &transition, int min_frames, 
+    double &final_score)
+{
+  std::vector<int> initial_path;
+  return FindRestrictedViterbiPath(pgram , transition, min_frames, 
+      initial_path, false, final_score);
+}
+
+std::vector<int> FindRestrictedViterbiPath(
+    const statistics::SparsePosteriorgram &pgram,
+    const utilities::Matrix<double> &transition, int min_frames, 
+    std::vector<int> initial_path, bool force_align, double &final_score)
+{
+  return ColumnRestrictedViterbiPath(pgram, pgram.posteriors(), pgram.frames(),
+      transition, min_frames, initial_path, force_align, final_score);
+}
+
+std::vector<int> FindViterbiPath(
+    const statistics::QuantizedPosteriorgram &pgram,
+    const utilities::Matrix<double> &transition, int min_frames, 
+    double &final_score)
+{
+  std::vector<int> initial_path;
+  return FindRestrictedViterbiPath(pgram , transition, min_frames, 
+      initial_path, false, final_score);
+}
+
+std::vector<int> FindRestrictedViterbiPath(
+    const statistics::QuantizedPosteriorgram &pgram,
+    const utilities::Matrix<double> &transition, int min_frames, 
+    std::vector<int> initial_path, bool force_align, double &final_score)
+{
+  return ColumnRestrictedViterbiPath(pgram, pgram.rows(), pgram.frames(),
+      transition, min_frames, initial_path, force_align, final_score);
+}
+
+// Only the score columns at every checkpoint are kept during the forward pass.
+// During the traceback, each segment between two checkpoints is decoded a
+// second time so that its backpointers can be recovered. The frames of a
+// segment are stored in a (state x segment length) block that is reused for
+// every segment.
+std::vector<int> FindCheckpointedViterbiPath(
+    const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align, 
+    double &final_score, unsigned int interval)
+{
+  std::vector<int> ret;
+  unsigned int states = (pgram.NumRows() + initial_path.size()) * min_frames;
+  unsigned int frames = pgram.NumCols();
+  if(frames == 0)
+    return ret;
+  if(interval == 0) // Default to sqrt(F) frames between checkpoints.
+    interval = static_cast<unsigned int>(
+        std::ceil(std::sqrt(static_cast<double>(frames))));
+  unsigned int checkpoints = ((frames - 1) / interval) + 1;
+
+  // Forward pass. checkpoint(c, s) is the score of state s at frame
+  // c * interval.
+  utilities::Matrix<double> checkpoint(checkpoints, states);
+  std::vector<ViterbiInfo> column;
+  std::vector<double> previous(states);
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    if(f == 0)
+      ViterbiInitialColumn(pgram, initial_path, min_frames, column);
+    else
+      ViterbiColumn(pgram, transition, min_frames, initial_path, f, previous,
+          column);
+    for(unsigned int s = 0; s < states; ++s)
+      previous[s] = column[s].score;
+    if(f % interval == 0)
+      for(unsigned int s = 0; s < states; ++s)
+        checkpoint(f / interval, s) = previous[s];
+  }
+
+  // Find the ending point in the same way as BestPathInDpMatrix.
+  int last_index = std::max(static_cast<int>(initial_path.size())-1, 0);
+  last_index = (last_index * min_frames) + min_frames - 1;
+  int state = last_index;
+  final_score = previous[last_index];
+  if(!force_align) // Final state is not necessarily part of initial_path.
+  {
+    for(unsigned int s = last_index; s < states; s+=min_frames)
+    {
+      if(previous[s] > final_score)
+      {
+        state = s;
+        final_score = previous[s];
+      }
+    }
+  }
+
+  // Traceback. Segment c recovers the parents for the frames in 
+  // (c * interval, (c+1) * interval].
+  std::vector<int> expanded_path(frames);
+  utilities::Matrix<int> parent(states, interval);
+  expanded_path[frames-1] = state;
+  for(int c = checkpoints - 1; c >= 0; --c)
+  {
+    unsigned int start = c * interval;
+    unsigned int end = std::min(start + interval, frames - 1);
+    previous = checkpoint.GetRow(c);
+    for(unsigned int f = start + 1; f <= end; ++f)
+    {
+      ViterbiColumn(pgram, transition, min_frames, initial_path, f, previous,
+          column);
+      for(unsigned int s = 0; s < states; ++s)
+      {
+        previous[s] = column[s].score;
+        parent(s, f - start - 1) = column[s].parent;
+      }
+    }
+    for(unsigned int f = end; f > start; --f)
+    {
+      state = parent(state, f - start - 1);
+      expanded_path[f-1] = state;
+    }
+  }
+
+  // Collapse the expanded states back to the original state indices.
+  int last = -1;
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    int index = OriginalState(initial_path, min_frames, expanded_path[f]);
+    if(index != last)
+      ret.push_back(index);
+    last = index;
+  }
+  return ret;
+}
+
+void ViterbiInitialColumn(const utilities::Matrix<double> &pgram,
+    const std::vector<int> &initial_path, int min_frames,
+    std::vector<ViterbiInfo> &column)
+{
+  unsigned int states = (pgram.NumRows() + initial_path.size()) * min_frames;
   double zero_log = -1000000;    // Essentially represents log(0). Used for
                                  // states that should be unreachable.
   double minimum_log = -50;
-
-  // We initialize the the dp_matrix. Initially, every state is set with the
-  // minimum score and considered inaccessible. If there is an initial path 
-  // restriction, then only the first overall state is a valid start state.
-  // Otherwise, the initial substate for every state is valid.
   ViterbiInfo default_value;
   default_value.parent = -1;
   default_value.score = zero_log;
-  dp_matrix.Initialize(states, frames, default_value);
+  column.assign(states, default_value);
 
+  // If there is an initial path restriction, then only the first overall state
+  // is a valid start state. Otherwise, the initial substate for every state is
+  // valid.
   if(initial_path.size() > 0) // Only first overall state is a valid start
   {                           // state.
-    dp_matrix(0,0).score = std::max(
+    column[0].score = std::max(
         GetStateScore(pgram, initial_path, min_frames, 0, 0), minimum_log);
   }
   else // The first substate of every original state is a valid start state.
   {
     for(unsigned int i = 0; i < states; i+= min_frames)
-      dp_matrix(i, 0).score = std::max(
+      column[i].score = std::max(
           GetStateScore(pgram, initial_path, min_frames, i, 0), minimum_log);
   }
-  
-  // Fill in the remainder of the dp_matrix
+}
+
+void ViterbiColumn(const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, unsigned int frame,
+    const std::vector<double> &previous, std::vector<ViterbiInfo> &column)
+{
+  unsigned int states = previous.size();
+  double zero_log = -1000000;
+  double minimum_log = -50;
+  column.resize(states);
+
+  // While the transistion logic has been pushed off to a separate function it
+  // is too slow to loop over the full number of states. Instead we limit the
+  // innermost loop to only valid transitions.
+  for(unsigned int s = 0; s < states; ++s)
+  {
+    ViterbiInfo best_point;
+    best_point.parent = s; // Begin with self-transition since that is always
+                           // legal.
+    best_point.score = previous[s] + std::max(
+        GetTransitionScore(transition, initial_path, min_frames, s, s),
+        zero_log);
+    if( (s < (initial_path.size() * min_frames) ) || // Still initial path
+        (s % min_frames > 0) ) // Transition within the set of substates.
+    { // Only self loop and immediately previous state are valid.
+      if(s > 0) // Can only come from the immediately preceeding state if one
+      {         // exists.
+        double score = previous[s-1] + std::max(
+            GetTransitionScore(transition, initial_path, min_frames, s-1, s),
+            zero_log);
+        if(score > best_point.score)
+        {
+          best_point.score = score;
+          best_point.parent = s-1;
+        }
+      }
+    }
+    else // Can transition to the start substate of any state, except those in
+    {    // the initial path.
+      unsigned int first_parent = min_frames - 1;
+      // Only the final substate in the initial_path can transition to the
+      // rest of the states outside the initial_path.
+      if(initial_path.size() > 0) 
+        first_parent += ( (initial_path.size() - 1) * min_frames);
+      for(unsigned int p = first_parent; p < states; p+=min_frames)
+      {
+        double score = previous[p] + std::max(
+            GetTransitionScore(transition, initial_path, min_frames, p, s),
+            zero_log);
+        if(score > best_point.score)
+        {
+          best_point.score = score;
+          best_point.parent = p;
+        }
+      } // end for p
+    }
+    best_point.score += std::max(
+        GetStateScore(pgram, initial_path, min_frames, s, frame), minimum_log);
+    column[s] = best_point;
+  } // end for s
+}
+
+// Tokens move through the same expanded states as FindViterbiPath. A token
+// only extends its sequence when it enters the first substate of a state that
+// differs from the last state in the sequence, which matches the way
+// BestPathInDpMatrix collapses the expanded states. Candidates for the first
+// substates are sorted before their sequences are looked up, so lattice nodes
+// are only created for tokens that survive.
+std::vector<ScoredPath> FindNBestPaths(const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    unsigned int n, std::vector<LatticeNode> &lattice)
+{
+  std::vector<ScoredPath> ret;
+  std::vector<int> initial_path; // Decoding is never restricted.
+  std::map<std::pair<int, int>, int> children;
+  unsigned int states = pgram.NumRows() * min_frames;
+  unsigned int frames = pgram.NumCols();
+  double zero_log = -1000000;
+  double minimum_log = -50;
+  lattice.clear();
+  if(frames == 0 || n == 0)
+    return ret;
+
+  std::vector<std::vector<ViterbiToken> > previous(states), current(states);
+  for(unsigned int s = 0; s < states; s+=min_frames)
+  {
+    ViterbiToken token;
+    token.score = std::max(
+        GetStateScore(pgram, initial_path, min_frames, s, 0), minimum_log);
+    token.sequence = LatticeChild(children, lattice, -1, s / min_frames);
+    previous[s].push_back(token);
+  }
+
+  // Candidates for the first substate of a state. The sequence of a candidate
+  // is the sequence of its parent token and is only extended by the new state
+  // if second is set and the candidate is kept.
+  std::vector<std::pair<ViterbiToken, bool> > candidates;
+  unsigned int prune_size = 2 * states * n;
   for(unsigned int f = 1; f < frames; ++f)
   {
-    // While the transistion logic has been pushed off to a separate function it
-    // is too slow to loop over the full number of states. Instead we limit the
-    // innermost loop to only valid transitions.
     for(unsigned int s = 0; s < states; ++s)
     {
-      ViterbiInfo best_point;
-      best_point.parent = s; // Begin with self-transition since that is always
-                             // legal.
-      best_point.score = dp_matrix(s, f-1).score + std::max(
-          GetTransitionScore(transition, initial_path, min_frames, s, s),
-          zero_log);
-      if( (s < (initial_path.size() * min_frames) ) || // Still initial path
-          (s % min_frames > 0) ) // Transition within the set of substates.
-      { // Only self loop and immediately previous state are valid.
-        if(s > 0) // Can only come from the immediately preceeding state if one
-        {         // exists.
-          double score = dp_matrix(s-1, f-1).score + std::max(
-              GetTransitionScore(transition, initial_path, min_frames, s-1, s),
-              zero_log);
-          if(score > best_point.score)
+      int state = s / min_frames;
+      double state_score = std::max(
+          GetStateScore(pgram, initial_path, min_frames, s, f), minimum_log);
+      current[s].clear();
+      if(s % min_frames > 0) // Self loop or the preceeding substate.
+      {
+        for(int p = s - 1; p <= static_cast<int>(s); ++p)
+        {
+          double trans = std::max(GetTransitionScore(transition,
+              initial_path, min_frames, p, s), zero_log) + state_score;
+          for(unsigned int t = 0; t < previous[p].size(); ++t)
           {
-            best_point.score = score;
-            best_point.parent = s-1;
+            ViterbiToken token = previous[p][t];
+            token.score += trans;
+            current[s].push_back(token);
           }
         }
+        KeepBestTokens(current[s], n);
+        continue;
       }
-      else // Can transition to the start substate of any state, except those in
-      {    // the initial path.
-        unsigned int first_parent = min_frames - 1;
-        // Only the final substate in the initial_path can transition to the
-        // rest of the states outside the initial_path.
-        if(initial_path.size() > 0) 
-          first_parent += ( (initial_path.size() - 1) * min_frames);
-        for(unsigned int p = first_parent; p < states; p+=min_frames)
+
+      // First substate. Self loop or the final substate of any state.
+      candidates.clear();
+      for(unsigned int t = 0; t < previous[s].size(); ++t)
+      {
+        ViterbiToken token = previous[s][t];
+        token.score += std::max(GetTransitionScore(transition, initial_path,
+            min_frames, s, s), zero_log) + state_score;
+        candidates.push_back(std::make_pair(token, false));
+      }
+      for(unsigned int p = min_frames - 1; p < states; p+=min_frames)
+      {
+        double trans = std::max(GetTransitionScore(transition, initial_path,
+            min_frames, p, s), zero_log) + state_score;
+        for(unsigned int t = 0; t < previous[p].size(); ++t)
         {
-          double score = dp_matrix(p, f-1).score + std::max(
-              GetTransitionScore(transition, initial_path, min_frames, p, s),
-              zero_log);
-          if(score > best_point.score)
-          {
-            best_point.score = score;
-            best_point.parent = p;
-          }
-        } // end for p
+          ViterbiToken token = previous[p][t];
+          token.score += trans;
+          candidates.push_back(std::make_pair(token, 
+              lattice[token.sequence].state != state));
+        }
+      }
+      std::sort(candidates.begin(), candidates.end(), CompareCandidateScore);
+      for(unsigned int i = 0; i < candidates.size() && current[s].size() < n;
+          ++i)
+      {
+        ViterbiToken token = candidates[i].first;
+        if(candidates[i].second)
+          token.sequence = LatticeChild(children, lattice, token.sequence,
+              state);
+        bool duplicate = false;
+        for(unsigned int t = 0; t < current[s].size(); ++t)
+          if(current[s][t].sequence == token.sequence)
+            duplicate = true;
+        if(!duplicate)
+          current[s].push_back(token);
       }
-      best_point.score += std::max(
-          GetStateScore(pgram, initial_path, min_frames, s, f), minimum_log);
-      dp_matrix(s, f) = best_point;
     } // end for s
+    previous.swap(current);
+    if(lattice.size() > prune_size)
+    {
+      PruneLattice(previous, children, lattice);
+      prune_size = std::max(prune_size, 2 * static_cast<unsigned int>(
+          lattice.size()));
+    }
   } // end for f
 
-  // Set the final_score and return the best path.
-  return BestPathInDpMatrix(dp_matrix, min_frames, initial_path, force_align, 
-      final_score);
+  // Paths may end in the final substate of any state.
+  std::vector<ViterbiToken> final_tokens;
+  for(unsigned int s = min_frames - 1; s < states; s+=min_frames)
+    final_tokens.insert(final_tokens.end(), previous[s].begin(), 
+        previous[s].end());
+  KeepBestTokens(final_tokens, n);
+  std::vector<std::vector<ViterbiToken> > survivors(1, final_tokens);
+  PruneLattice(survivors, children, lattice);
+
+  for(unsigned int t = 0; t < survivors[0].size(); ++t)
+  {
+    ScoredPath scored_path;
+    scored_path.score = survivors[0][t].score;
+    scored_path.node = survivors[0][t].sequence;
+    for(int node = scored_path.node; node >= 0; node = lattice[node].parent)
+      scored_path.path.push_back(lattice[node].state);
+    std::reverse(scored_path.path.begin(), scored_path.path.end());
+    ret.push_back(scored_path);
+  }
+  return ret;
 }
 
 std::vector<int> BestPathInSet(                                          
     const std::vector<utilities::Matrix<double> > &pgram_set,                    
-    const utilities::Matrix<double> &transition, int min_frames)
+    const utilities::Matrix<double> &transition, int min_frames,
+    bool use_forward)
 {
   std::vector<std::vector<int> > path_set;
-  std::vector<double> path_score;
-  double score;
-  for(unsigned int i = 0; i < pgram_set.size(); ++i)
-  {
-    std::vector<int> path;
-    path = FindViterbiPath(pgram_set[i], transition,
-          min_frames, score);
-    path_set.push_back(path);
+  std::vector<double> path_score, score;
+  std::vector<int> initial_path;
+  path_set = BatchRestrictedViterbiPath(pgram_set, transition, min_frames,
+      initial_path, false, score);
+  for(unsigned int i = 0; i < path_set.size(); ++i)
+  {
     double total_score = 0;
     // Check the score for every example in pgram_set
-    for(unsigned int j = 0; j < pgram_set.size(); ++j)
+    if(use_forward)
     {
-      FindRestrictedViterbiPath(pgram_set[j] , transition, min_frames, 
-          path, true, score);
-      total_score += score;
+      ExpandedTopology topology = BuildExpandedTopology(
+          pgram_set[i].NumRows(), transition, min_frames, path_set[i], true);
+      for(unsigned int j = 0; j < pgram_set.size(); ++j)
+        total_score += ForwardScore(pgram_set[j], topology, true);
+    }
+    else
+    {
+      BatchRestrictedViterbiPath(pgram_set, transition, min_frames, 
+          path_set[i], true, score);
+      for(unsigned int j = 0; j < pgram_set.size(); ++j)
+        total_score += score[j];
     }
     path_score.push_back(total_score);
   }
@@ -240,6 +546,244 @@ std::vector<int> BestPathInSet(
   return path_set[best_index];
 }
 
+// delta(s, f) is the best score of a path whose last segment is state s and
+// ends at frame f. entry(s, f) is the best score of entering state s at frame
+// f+1, which is shared by every duration of the next segment.
+std::vector<int> FindSegmentalViterbiPath(
+    const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition,
+    const utilities::Matrix<double> &duration, double &final_score,
+    std::vector<int> &segment_start)
+{
+  std::vector<int> ret;
+  unsigned int states = pgram.NumRows();
+  unsigned int frames = pgram.NumCols();
+  double zero_log = -1000000;
+  segment_start.clear();
+  final_score = zero_log;
+  if(frames == 0)
+    return ret;
+
+  // Range of valid durations for each state.
+  std::vector<unsigned int> min_duration(states, 0), max_duration(states, 0);
+  for(unsigned int s = 0; s < states; ++s)
+    for(unsigned int d = duration.NumCols(); d > 0; --d)
+      if(duration(s, d-1) > zero_log)
+      {
+        min_duration[s] = d;
+        if(max_duration[s] == 0)
+          max_duration[s] = d;
+      }
+
+  utilities::Matrix<double> cumulative = CumulativeStateScores(pgram);
+  utilities::Matrix<double> delta(states, frames, zero_log);
+  utilities::Matrix<double> entry(states, frames, zero_log);
+  utilities::Matrix<int> best_duration(states, frames, 0);
+  utilities::Matrix<int> best_parent(states, frames, -1);
+
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    for(unsigned int s = 0; s < states; ++s)
+    {
+      if(max_duration[s] == 0)
+        continue;
+      double end_score = cumulative(s, f + 1);
+      unsigned int longest = std::min(max_duration[s], f + 1);
+      for(unsigned int d = min_duration[s]; d <= longest; ++d)
+      {
+        if(duration(s, d-1) <= zero_log)
+          continue;
+        unsigned int start = f + 1 - d;
+        double previous = (start == 0) ? 0 : entry(s, start - 1);
+        double score = previous + duration(s, d-1) + end_score - 
+            cumulative(s, start);
+        if(score > delta(s, f))
+        {
+          delta(s, f) = score;
+          best_duration(s, f) = d;
+        }
+      }
+    }
+    // Best way to leave frame f into each state.
+    for(unsigned int s = 0; s < states; ++s)
+      for(unsigned int p = 0; p < states; ++p)
+      {
+        if(p == s)
+          continue;
+        double score = delta(p, f) + std::max(transition(p, s), zero_log);
+        if(score > entry(s, f))
+        {
+          entry(s, f) = score;
+          best_parent(s, f) = p;
+        }
+      }
+  }
+
+  int state = -1;
+  for(unsigned int s = 0; s < states; ++s)
+    if(best_duration(s, frames-1) > 0 && delta(s, frames-1) > final_score)
+    {
+      final_score = delta(s, frames-1);
+      state = s;
+    }
+  int f = frames - 1;
+  while(state >= 0 && f >= 0)
+  {
+    int start = f + 1 - best_duration(state, f);
+    ret.push_back(state);
+    segment_start.push_back(start);
+    f = start - 1;
+    if(f >= 0)
+      state = best_parent(state, f);
+  }
+  std::reverse(ret.begin(), ret.end());
+  std::reverse(segment_start.begin(), segment_start.end());
+  return ret;
+}
+
+// Uses the transitions in ExpandedTopology, but the candidates are visited in
+// the same order as ViterbiColumn so that ties are broken in the same way. When
+// force_align is set the topology leaves out the states outside of the
+// initial path, which can never reach the end state.
+std::vector<std::vector<int> > BatchRestrictedViterbiPath(
+    const std::vector<utilities::Matrix<double> > &pgram_set,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align,
+    std::vector<double> &final_scores)
+{
+  unsigned int batch = pgram_set.size();
+  std::vector<std::vector<int> > ret(batch);
+  final_scores.assign(batch, 0);
+  if(batch == 0)
+    return ret;
+  ExpandedTopology topology = BuildExpandedTopology(pgram_set[0].NumRows(),
+      transition, min_frames, initial_path, force_align);
+  unsigned int states = topology.row.size();
+  unsigned int frames = 0;
+  std::vector<unsigned int> member_frames(batch);
+  for(unsigned int b = 0; b < batch; ++b)
+  {
+    member_frames[b] = pgram_set[b].NumCols();
+    frames = std::max(frames, member_frames[b]);
+  }
+  double zero_log = -1000000;
+  double minimum_log = -50;
+
+  // BuildExpandedTopology removes the self loop of entry states that are also
+  // exits, but here it is needed to match the order of ViterbiColumn.
+  std::vector<double> self = topology.self;
+  for(unsigned int k = 0; k < topology.entry.size(); ++k)
+  {
+    int j = topology.exit_index[ topology.entry[k] ];
+    if(j >= 0)
+      self[ topology.entry[k] ] = topology.entry_transition(k, j);
+  }
+
+  // parent[(f * states + s) * batch + b]
+  std::vector<int> parent(static_cast<size_t>(frames) * states * batch, -1);
+  std::vector<double> previous(states * batch, zero_log);
+  std::vector<double> current(states * batch), emission(states * batch);
+  std::vector<double> best(batch);
+  std::vector<int> best_parent(batch);
+
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    for(unsigned int b = 0; b < batch; ++b)
+      if(f < member_frames[b])
+        for(unsigned int s = 0; s < states; ++s)
+          emission[s * batch + b] = std::max(
+              pgram_set[b](topology.row[s], f), minimum_log);
+    int *frame_parent = &parent[static_cast<size_t>(f) * states * batch];
+    if(f == 0)
+    {
+      for(unsigned int s = 0; s < states; ++s)
+        for(unsigned int b = 0; b < batch; ++b)
+          previous[s * batch + b] = topology.start[s] ?
+              emission[s * batch + b] : zero_log;
+      continue;
+    }
+    for(unsigned int s = 0; s < states; ++s)
+    {
+      const double *self_score = &previous[s * batch];
+      for(unsigned int b = 0; b < batch; ++b)
+      {
+        best[b] = self_score[b] + self[s];
+        best_parent[b] = s;
+      }
+      int k = topology.entry_index[s];
+      if(k >= 0)
+      {
+        for(unsigned int j = 0; j < topology.exit.size(); ++j)
+        {
+          int p = topology.exit[j];
+          double trans = topology.entry_transition(k, j);
+          const double *parent_score = &previous[p * batch];
+          for(unsigned int b = 0; b < batch; ++b)
+          {
+            double score = parent_score[b] + trans;
+            bool better = score > best[b];
+            best[b] = better ? score : best[b];
+            best_parent[b] = better ? p : best_parent[b];
+          }
+        }
+      }
+      else if(s > 0)
+      {
+        const double *parent_score = &previous[(s-1) * batch];
+        for(unsigned int b = 0; b < batch; ++b)
+        {
+          double score = parent_score[b] + topology.previous[s];
+          bool better = score > best[b];
+          best[b] = better ? score : best[b];
+          best_parent[b] = better ? s - 1 : best_parent[b];
+        }
+      }
+      // Members without any frames left keep their previous score.
+      for(unsigned int b = 0; b < batch; ++b)
+      {
+        bool active = f < member_frames[b];
+        current[s * batch + b] = active ? 
+            best[b] + emission[s * batch + b] : self_score[b];
+        frame_parent[s * batch + b] = best_parent[b];
+      }
+    }
+    previous.swap(current);
+  }
+
+  // Find the end point and trace back each member as in BestPathInDpMatrix.
+  int last_index = std::max(static_cast<int>(initial_path.size())-1, 0);
+  last_index = (last_index * min_frames) + min_frames - 1;
+  for(unsigned int b = 0; b < batch; ++b)
+  {
+    if(member_frames[b] == 0)
+      continue;
+    int state = last_index;
+    final_scores[b] = previous[last_index * batch + b];
+    if(!force_align)
+    {
+      for(unsigned int s = last_index; s < states; s+=min_frames)
+      {
+        if(previous[s * batch + b] > final_scores[b])
+        {
+          state = s;
+          final_scores[b] = previous[s * batch + b];
+        }
+      }
+    }
+    int last = -1;
+    for(int f = member_frames[b] - 1; f >= 0; --f)
+    {
+      int index = OriginalState(initial_path, min_frames, state);
+      if(index != last)
+        ret[b].push_back(index);
+      last = index;
+      state = parent[(static_cast<size_t>(f) * states + state) * batch + b];
+    }
+    std::reverse(ret[b].begin(), ret[b].end());
+  }
+  return ret;
+}
+
 // The algorithm fills the dp_matrix by finding the best path that goes through
 // a particular state. If the best path with /ae/ as the second state starts
 // at /k/, then we assume the best path of any path with /ae/ as the second
@@ -252,6 +796,7 @@ std::vector<int> ApproximateViterbiSet(
   double zero_log = -1000000; // Used for unreachable states.
   utilities::Matrix<ViterbiInfo> dp_matrix;
   std::vector<ViterbiInfo> end_point;
+  std::vector<double> score; // Score of each member of the set.
   ViterbiInfo default_point;
   default_point.parent = -1;
   default_point.score = zero_log;
@@ -286,13 +831,11 @@ std::vector<int> ApproximateViterbiSet(
               f-1);
           initial_path.push_back(p);
           initial_path.push_back(s);
-          double score = 0, final_score = 0;
+          double final_score = 0;
+          BatchRestrictedViterbiPath(pgram_set, transition, min_frames, 
+              initial_path, false, score);
           for(unsigned int i = 0; i < pgram_set.size(); ++i)
-          {
-            FindRestrictedViterbiPath(pgram_set[i], transition, min_frames, 
-                initial_path, false, score);
-            final_score += score;
-          }
+            final_score += score[i];
           final_score = final_score / pgram_set.size();
           if(final_score > dp_matrix(s, f).score)
           {
@@ -308,13 +851,11 @@ std::vector<int> ApproximateViterbiSet(
       std::vector<int> initial_path = BestSubPathInViterbiSet(dp_matrix, p, 
           f-1);
       initial_path.push_back(p);
-      double score = 0, final_score = 0;
+      double final_score = 0;
+      BatchRestrictedViterbiPath(pgram_set, transition, min_frames, 
+          initial_path, true, score);
       for(unsigned int i = 0; i < pgram_set.size(); ++i)
-      {
-        FindRestrictedViterbiPath(pgram_set[i], transition, min_frames, 
-            initial_path, true, score);
-        final_score += score;
-      }
+        final_score += score[i];
       final_score = final_score / pgram_set.size();
       if(final_score > end_point[f].score)
       {
@@ -407,6 +948,520 @@ std::vector<int> BestPathInDpMatrix(
   return ret;
 }
 
+// The alpha columns for every frame are kept, while the backward recursion
+// only keeps the column for the following frame. The occupancy of each frame is
+// accumulated as soon as its beta column is known.
+double ForwardBackward(const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align,
+    utilities::Matrix<double> &occupancy, bool scaled)
+{
+  ExpandedTopology topology = BuildExpandedTopology(pgram.NumRows(), 
+      transition, min_frames, initial_path, force_align);
+  unsigned int states = topology.row.size();
+  unsigned int frames = pgram.NumCols();
+  double zero_log = -1000000;
+  occupancy.Initialize(pgram.NumRows(), frames, 0);
+  if(frames == 0)
+    return zero_log;
+
+  std::vector<std::vector<double> > alpha(frames);
+  std::vector<double> scores, beta(states), next(states);
+  std::vector<double> max_score(frames), scale(frames);
+  double log_likelihood = 0;
+  bool underflow = !scaled;
+
+  if(scaled)
+  {
+    // Forward recursion on scaled probabilities. scale[f] is the sum of the
+    // column before normalization and max_score[f] the scaling of the state
+    // likelihoods.
+    for(unsigned int f = 0; f < frames && !underflow; ++f)
+    {
+      ExpandedStateScores(pgram, topology, f, scores);
+      max_score[f] = *std::max_element(scores.begin(), scores.end());
+      for(unsigned int s = 0; s < states; ++s)
+        scores[s] = std::exp(scores[s] - max_score[f]);
+      if(f == 0)
+      {
+        alpha[0].assign(states, 0);
+        scale[0] = 0;
+        for(unsigned int s = 0; s < states; ++s)
+          if(topology.start[s])
+          {
+            alpha[0][s] = scores[s];
+            scale[0] += scores[s];
+          }
+      }
+      else
+        scale[f] = ScaledForwardColumn(topology, scores, alpha[f-1], alpha[f]);
+      if(!(scale[f] > 0) || std::isinf(scale[f]))
+        underflow = true;
+      else
+      {
+        for(unsigned int s = 0; s < states; ++s)
+          alpha[f][s] /= scale[f];
+        log_likelihood += std::log(scale[f]) + max_score[f];
+      }
+    }
+    double end_mass = 0;
+    if(!underflow)
+    {
+      for(unsigned int s = 0; s < states; ++s)
+        if(topology.end[s])
+          end_mass += alpha[frames-1][s];
+      if(!(end_mass > 0))
+        underflow = true;
+    }
+    if(!underflow)
+    {
+      log_likelihood += std::log(end_mass);
+      for(unsigned int s = 0; s < states; ++s)
+        beta[s] = topology.end[s] ? 1 : 0;
+      for(int f = frames - 1; f >= 0; --f)
+      {
+        if(f < static_cast<int>(frames) - 1)
+        {
+          ExpandedStateScores(pgram, topology, f + 1, scores);
+          for(unsigned int s = 0; s < states; ++s)
+            scores[s] = std::exp(scores[s] - max_score[f+1]);
+          ScaledBackwardColumn(topology, scores, next, beta);
+          for(unsigned int s = 0; s < states; ++s)
+            beta[s] /= scale[f+1];
+        }
+        for(unsigned int s = 0; s < states; ++s)
+          occupancy(topology.row[s], f) += 
+              alpha[f][s] * beta[s] / end_mass;
+        next.swap(beta);
+      }
+      return log_likelihood;
+    }
+  }
+
+  // Forward recursion in the log domain.
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    ExpandedStateScores(pgram, topology, f, scores);
+    if(f == 0)
+    {
+      alpha[0].assign(states, zero_log);
+      for(unsigned int s = 0; s < states; ++s)
+        if(topology.start[s])
+          alpha[0][s] = scores[s];
+    }
+    else
+      ForwardColumn(topology, scores, alpha[f-1], alpha[f]);
+  }
+  std::vector<double> end_scores;
+  for(unsigned int s = 0; s < states; ++s)
+    if(topology.end[s])
+      end_scores.push_back(alpha[frames-1][s]);
+  log_likelihood = utilities::LogSumExp(end_scores);
+
+  occupancy.Initialize(pgram.NumRows(), frames, 0);
+  for(unsigned int s = 0; s < states; ++s)
+    beta[s] = topology.end[s] ? 0 : zero_log;
+  for(int f = frames - 1; f >= 0; --f)
+  {
+    if(f < static_cast<int>(frames) - 1)
+    {
+      ExpandedStateScores(pgram, topology, f + 1, scores);
+      BackwardColumn(topology, scores, next, beta);
+    }
+    for(unsigned int s = 0; s < states; ++s)
+      occupancy(topology.row[s], f) += 
+          std::exp(alpha[f][s] + beta[s] - log_likelihood);
+    next.swap(beta);
+  }
+  return log_likelihood;
+}
+
+double ForwardScore(const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align, bool scaled)
+{
+  ExpandedTopology topology = BuildExpandedTopology(pgram.NumRows(), 
+      transition, min_frames, initial_path, force_align);
+  return ForwardScore(pgram, topology, scaled);
+}
+
+double ForwardScore(const utilities::Matrix<double> &pgram,
+    const ExpandedTopology &topology, bool scaled)
+{
+  unsigned int states = topology.row.size();
+  unsigned int frames = pgram.NumCols();
+  double zero_log = -1000000;
+  if(frames == 0)
+    return zero_log;
+  std::vector<double> scores, previous(states), current(states);
+
+  if(scaled)
+  {
+    double log_likelihood = 0;
+    bool underflow = false;
+    for(unsigned int f = 0; f < frames && !underflow; ++f)
+    {
+      ExpandedStateScores(pgram, topology, f, scores);
+      double max_score = *std::max_element(scores.begin(), scores.end());
+      for(unsigned int s = 0; s < states; ++s)
+        scores[s] = std::exp(scores[s] - max_score);
+      double scale = 0;
+      if(f == 0)
+      {
+        for(unsigned int s = 0; s < states; ++s)
+        {
+          current[s] = topology.start[s] ? scores[s] : 0;
+          scale += current[s];
+        }
+      }
+      else
+        scale = ScaledForwardColumn(topology, scores, previous, current);
+      if(!(scale > 0) || std::isinf(scale))
+        underflow = true;
+      else
+      {
+        for(unsigned int s = 0; s < states; ++s)
+          current[s] /= scale;
+        log_likelihood += std::log(scale) + max_score;
+      }
+      previous.swap(current);
+    }
+    double end_mass = 0;
+    for(unsigned int s = 0; s < states; ++s)
+      if(topology.end[s])
+        end_mass += previous[s];
+    if(!underflow && end_mass > 0)
+      return log_likelihood + std::log(end_mass);
+  }
+
+  // Log domain recursion, also used if the scaled recursion underflows.
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    ExpandedStateScores(pgram, topology, f, scores);
+    if(f == 0)
+    {
+      for(unsigned int s = 0; s < states; ++s)
+        current[s] = topology.start[s] ? scores[s] : zero_log;
+    }
+    else
+      ForwardColumn(topology, scores, previous, current);
+    previous.swap(current);
+  }
+  std::vector<double> end_scores;
+  for(unsigned int s = 0; s < states; ++s)
+    if(topology.end[s])
+      end_scores.push_back(previous[s]);
+  return utilities::LogSumExp(end_scores);
+}
+
+ExpandedTopology BuildExpandedTopology(unsigned int rows,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align)
+{
+  ExpandedTopology topology;
+  double zero_log = -1000000;
+  unsigned int restricted = initial_path.size() * min_frames;
+  unsigned int states = restricted;
+  if(!force_align || initial_path.size() == 0)
+    states += rows * min_frames;
+
+  topology.row.resize(states);
+  topology.self.resize(states);
+  topology.previous.resize(states, zero_log);
+  topology.entry_index.resize(states, -1);
+  topology.exit_index.resize(states, -1);
+  topology.start.resize(states, false);
+  topology.end.resize(states, false);
+  for(unsigned int s = 0; s < states; ++s)
+  {
+    topology.row[s] = OriginalState(initial_path, min_frames, s);
+    topology.self[s] = std::max(GetTransitionScore(transition, initial_path,
+        min_frames, s, s), zero_log);
+    if(s > 0)
+      topology.previous[s] = std::max(GetTransitionScore(transition, 
+          initial_path, min_frames, s-1, s), zero_log);
+    if(s >= restricted && s % min_frames == 0)
+    {
+      topology.entry_index[s] = topology.entry.size();
+      topology.entry.push_back(s);
+    }
+  }
+  if(states > restricted)
+  {
+    unsigned int first_parent = min_frames - 1;
+    if(initial_path.size() > 0) 
+      first_parent += ( (initial_path.size() - 1) * min_frames);
+    for(unsigned int p = first_parent; p < states; p+=min_frames)
+    {
+      topology.exit_index[p] = topology.exit.size();
+      topology.exit.push_back(p);
+    }
+  }
+  // When min_frames is one, the self loop of an entry state is also one of
+  // its exits and must only be counted once.
+  for(unsigned int k = 0; k < topology.entry.size(); ++k)
+    if(topology.exit_index[topology.entry[k]] >= 0)
+      topology.self[topology.entry[k]] = zero_log;
+
+  topology.entry_transition.Initialize(topology.entry.size(),
+      topology.exit.size());
+  topology.exit_transition.Initialize(topology.exit.size(),
+      topology.entry.size());
+  for(unsigned int k = 0; k < topology.entry.size(); ++k)
+    for(unsigned int j = 0; j < topology.exit.size(); ++j)
+    {
+      topology.entry_transition(k, j) = std::max(GetTransitionScore(
+          transition, initial_path, min_frames, topology.exit[j],
+          topology.entry[k]), zero_log);
+      topology.exit_transition(j, k) = topology.entry_transition(k, j);
+    }
+
+  if(initial_path.size() > 0)
+    topology.start[0] = true;
+  else
+    for(unsigned int s = 0; s < states; s+=min_frames)
+      topology.start[s] = true;
+  int last_index = std::max(static_cast<int>(initial_path.size())-1, 0);
+  last_index = (last_index * min_frames) + min_frames - 1;
+  topology.end[last_index] = true;
+  if(!force_align)
+    for(unsigned int s = last_index; s < states; s+=min_frames)
+      topology.end[s] = true;
+
+  // Probability domain copies for the scaled recursions.
+  topology.self_prob.resize(states);
+  topology.previous_prob.resize(states);
+  for(unsigned int s = 0; s < states; ++s)
+  {
+    topology.self_prob[s] = std::exp(topology.self[s]);
+    topology.previous_prob[s] = std::exp(topology.previous[s]);
+  }
+  topology.entry_prob = topology.entry_transition;
+  topology.exit_prob = topology.exit_transition;
+  for(unsigned int k = 0; k < topology.entry.size(); ++k)
+    for(unsigned int j = 0; j < topology.exit.size(); ++j)
+    {
+      topology.entry_prob(k, j) = std::exp(topology.entry_transition(k, j));
+      topology.exit_prob(j, k) = topology.entry_prob(k, j);
+    }
+  return topology;
+}
+
+void ForwardColumn(const ExpandedTopology &topology,
+    const std::vector<double> &scores, const std::vector<double> &previous,
+    std::vector<double> &current)
+{
+  unsigned int states = topology.row.size();
+  unsigned int exits = topology.exit.size();
+  current.resize(states);
+  // The exits are gathered once since they are shared by every entry state.
+  // The last element of buffer holds the self loop.
+  std::vector<double> gathered(exits), buffer(exits + 1);
+  for(unsigned int j = 0; j < exits; ++j)
+    gathered[j] = previous[ topology.exit[j] ];
+
+  for(unsigned int s = 0; s < states; ++s)
+  {
+    int k = topology.entry_index[s];
+    if(k >= 0)
+    {
+      for(unsigned int j = 0; j < exits; ++j)
+        buffer[j] = gathered[j] + topology.entry_transition(k, j);
+      buffer[exits] = previous[s] + topology.self[s];
+      current[s] = scores[s] + utilities::LogSumExp(&buffer[0], exits + 1);
+    }
+    else if(s > 0)
+      current[s] = scores[s] + utilities::LogAdd(
+          previous[s] + topology.self[s],
+          previous[s-1] + topology.previous[s]);
+    else
+      current[s] = scores[s] + previous[s] + topology.self[s];
+  }
+}
+
+void BackwardColumn(const ExpandedTopology &topology,
+    const std::vector<double> &scores, const std::vector<double> &next,
+    std::vector<double> &current)
+{
+  unsigned int states = topology.row.size();
+  unsigned int entries = topology.entry.size();
+  current.resize(states);
+  std::vector<double> weighted(states), gathered(entries), buffer(entries + 2);
+  for(unsigned int s = 0; s < states; ++s)
+    weighted[s] = scores[s] + next[s];
+  for(unsigned int k = 0; k < entries; ++k)
+    gathered[k] = weighted[ topology.entry[k] ];
+
+  double zero_log = -1000000;
+  for(unsigned int s = 0; s < states; ++s)
+  {
+    double self = topology.self[s] + weighted[s];
+    double forward = zero_log;
+    if(s + 1 < states && topology.entry_index[s+1] < 0)
+      forward = topology.previous[s+1] + weighted[s+1];
+    int j = topology.exit_index[s];
+    if(j >= 0)
+    {
+      for(unsigned int k = 0; k < entries; ++k)
+        buffer[k] = gathered[k] + topology.exit_transition(j, k);
+      buffer[entries] = self;
+      buffer[entries+1] = forward;
+      current[s] = utilities::LogSumExp(&buffer[0], entries + 2);
+    }
+    else
+      current[s] = utilities::LogAdd(self, forward);
+  }
+}
+
+double ScaledForwardColumn(const ExpandedTopology &topology,
+    const std::vector<double> &likelihood, const std::vector<double> &previous,
+    std::vector<double> &current)
+{
+  unsigned int states = topology.row.size();
+  unsigned int exits = topology.exit.size();
+  current.resize(states);
+  std::vector<double> gathered(exits);
+  for(unsigned int j = 0; j < exits; ++j)
+    gathered[j] = previous[ topology.exit[j] ];
+
+  double total = 0;
+  for(unsigned int s = 0; s < states; ++s)
+  {
+    double value = previous[s] * topology.self_prob[s];
+    int k = topology.entry_index[s];
+    if(k >= 0)
+    {
+      for(unsigned int j = 0; j < exits; ++j)
+        value += gathered[j] * topology.entry_prob(k, j);
+    }
+    else if(s > 0)
+      value += previous[s-1] * topology.previous_prob[s];
+    current[s] = likelihood[s] * value;
+    total += current[s];
+  }
+  return total;
+}
+
+void ScaledBackwardColumn(const ExpandedTopology &topology,
+    const std::vector<double> &likelihood, const std::vector<double> &next,
+    std::vector<double> &current)
+{
+  unsigned int states = topology.row.size();
+  unsigned int entries = topology.entry.size();
+  current.resize(states);
+  std::vector<double> weighted(states), gathered(entries);
+  for(unsigned int s = 0; s < states; ++s)
+    weighted[s] = likelihood[s] * next[s];
+  for(unsigned int k = 0; k < entries; ++k)
+    gathered[k] = weighted[ topology.entry[k] ];
+
+  for(unsigned int s = 0; s < states; ++s)
+  {
+    double value = topology.self_prob[s] * weighted[s];
+    if(s + 1 < states && topology.entry_index[s+1] < 0)
+      value += topology.previous_prob[s+1] * weighted[s+1];
+    int j = topology.exit_index[s];
+    if(j >= 0)
+      for(unsigned int k = 0; k < entries; ++k)
+        value += gathered[k] * topology.exit_prob(j, k);
+    current[s] = value;
+  }
+}
+
+void ExpandedStateScores(const utilities::Matrix<double> &pgram,
+    const ExpandedTopology &topology, unsigned int frame,
+    std::vector<double> &scores)
+{
+  double minimum_log = -50;
+  scores.resize(topology.row.size());
+  for(unsigned int s = 0; s < scores.size(); ++s)
+    scores[s] = std::max(pgram(topology.row[s], frame), minimum_log);
+}
+
+utilities::Matrix<double> CumulativeStateScores(
+    const utilities::Matrix<double> &pgram)
+{
+  double minimum_log = -50;
+  utilities::Matrix<double> ret(pgram.NumRows(), pgram.NumCols() + 1, 0);
+  for(unsigned int s = 0; s < pgram.NumRows(); ++s)
+    for(unsigned int f = 0; f < pgram.NumCols(); ++f)
+      ret(s, f+1) = ret(s, f) + std::max(pgram(s, f), minimum_log);
+  return ret;
+}
+
+int LatticeChild(std::map<std::pair<int, int>, int> &children,
+    std::vector<LatticeNode> &lattice, int sequence, int state)
+{
+  std::pair<int, int> key = std::make_pair(sequence, state);
+  std::map<std::pair<int, int>, int>::iterator it = children.find(key);
+  if(it != children.end())
+    return it->second;
+  LatticeNode node;
+  node.state = state;
+  node.parent = sequence;
+  lattice.push_back(node);
+  children[key] = lattice.size() - 1;
+  return lattice.size() - 1;
+}
+
+// A parent is always created before its children, so renumbering the kept
+// nodes in order preserves the ordering.
+void PruneLattice(std::vector<std::vector<ViterbiToken> > &tokens,
+    std::map<std::pair<int, int>, int> &children,
+    std::vector<LatticeNode> &lattice)
+{
+  std::vector<int> index(lattice.size(), -1);
+  for(unsigned int s = 0; s < tokens.size(); ++s)
+    for(unsigned int t = 0; t < tokens[s].size(); ++t)
+      index[tokens[s][t].sequence] = 0;
+  for(int i = lattice.size() - 1; i >= 0; --i)
+    if(index[i] == 0 && lattice[i].parent >= 0)
+      index[lattice[i].parent] = 0;
+
+  std::vector<LatticeNode> kept;
+  children.clear();
+  for(unsigned int i = 0; i < lattice.size(); ++i)
+  {
+    if(index[i] < 0)
+      continue;
+    LatticeNode node = lattice[i];
+    if(node.parent >= 0)
+      node.parent = index[node.parent];
+    index[i] = kept.size();
+    children[std::make_pair(node.parent, node.state)] = index[i];
+    kept.push_back(node);
+  }
+  lattice.swap(kept);
+  for(unsigned int s = 0; s < tokens.size(); ++s)
+    for(unsigned int t = 0; t < tokens[s].size(); ++t)
+      tokens[s][t].sequence = index[tokens[s][t].sequence];
+}
+
+void KeepBestTokens(std::vector<ViterbiToken> &tokens, unsigned int n)
+{
+  std::vector<ViterbiToken> kept;
+  std::sort(tokens.begin(), tokens.end(), CompareTokenScore);
+  for(unsigned int i = 0; i < tokens.size() && kept.size() < n; ++i)
+  {
+    bool duplicate = false;
+    for(unsigned int k = 0; k < kept.size(); ++k)
+      if(kept[k].sequence == tokens[i].sequence)
+        duplicate = true;
+    if(!duplicate)
+      kept.push_back(tokens[i]);
+  }
+  tokens.swap(kept);
+}
+
+int OriginalState(const std::vector<int> &initial_path, int min_frames,
+    int state)
+{
+  int index = state / min_frames;
+  if( index < static_cast<int>(initial_path.size()) )
+    return initial_path[index];
+  return index - initial_path.size();
+}
+
 double GetStateScore(const utilities::Matrix<double> &pgram, 
     const std::vector<int> &initial_path, int min_frames, int state, int frame)
 {
@@ -481,4 +1536,18 @@ utilities::Matrix<double> GenerateTransitionMatrix(
   return ret;
 }
 
+utilities::Matrix<double> GenerateDurationMatrix(unsigned int states,
+    unsigned int min_frames, unsigned int max_frames, double self_loop_prob)
+{
+  utilities::Matrix<double> ret;
+  double log_self_loop_prob = std::log(self_loop_prob);
+
+  ret.Initialize(states, max_frames, -1000000);
+  for(unsigned int s = 0; s < states; ++s)
+    for(unsigned int d = std::max(min_frames, 1u); d <= max_frames; ++d)
+      ret(s, d-1) = (d - 1) * log_self_loop_prob;
+
+  return ret;
+}
+
 }
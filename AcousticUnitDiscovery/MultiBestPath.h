@@ -8,7 +8,12 @@
 #include<vector>
 #include<cmath>
 #include<algorithm>
+#include<map>
+#include<utility>
 #include "Matrix.h"
+#include "LogMath.h"
+#include "SparsePosteriorgram.h"
+#include "QuantizedPosteriorgram.h"
 #include "ImageIO.h"
 
 // MultiBestPath contains a set of functions for finding certain types of best
@@ -30,6 +35,29 @@
 // initial sequence of states. Can also perform a force alignment such that the
 // resulting path is identical to the given path.
 //
+// FindCheckpointedViterbiPath: Identical result to FindRestrictedViterbiPath,
+// but only keeps the scores of the current frame and of O(sqrt(F)) checkpoint
+// frames. The segments between checkpoints are decoded again during the
+// traceback. Intended for decoding whole utterances.
+//
+// FindNBestPaths: Finds the n best distinct sequences of states with k-best
+// token passing. Sequences that only differ in their timing are merged. The
+// sequences are also returned as a prefix tree lattice.
+//
+// ForwardBackward: Sums over every path instead of taking the best path.
+// Gives the occupancy of each state in each frame and the log likelihood of
+// the posteriorgram. Accepts the same initial_path restriction as
+// FindRestrictedViterbiPath.
+//
+// BatchRestrictedViterbiPath: Runs FindRestrictedViterbiPath on every
+// posteriorgram in a set at once. The scores are stored as [frame][state]
+// [member] so the innermost loop runs over the members of the set.
+//
+// FindSegmentalViterbiPath: Explicit duration (semi-Markov) version of the
+// viterbi algorithm. Each state is decoded as a whole segment, so the minimum
+// and maximum duration and the probability of each duration are given
+// directly instead of expanding the states.
+//
 // ApproximateViterbiSet: Given a set of posteriorgrams, finds the path that 
 // maximizes the likelihood for the entire set. The implementation is an 
 // approximation and does not guarentee the true path.
@@ -49,12 +77,71 @@ typedef struct
   double score; // Score for this particular point along the path.
 } ViterbiInfo;
 
+// A node in the prefix tree of state sequences explored by FindNBestPaths.
+// Every sequence that passes through a node shares the same prefix, so the
+// node and its ancestors form a compact lattice of the n-best list.
+typedef struct
+{
+  int state;  // Index of the original state.
+  int parent; // Index to the parent node, -1 for the first state.
+} LatticeNode;
+
+// Token used by the n-best token passing. The sequence is an index into the
+// lattice, so two tokens with the same sequence share the same state sequence
+// even if they have a different alignment.
+typedef struct
+{
+  double score;
+  int sequence;
+} ViterbiToken;
+
+// An entry in the n-best list.
+typedef struct
+{
+  std::vector<int> path; // Sequence of original states.
+  double score;          // Log score of the best alignment of the sequence.
+  int node;              // Final node of the sequence in the lattice.
+} ScoredPath;
+
+// Transition structure of the expanded states used by the forward-backward
+// functions. It is computed once by BuildExpandedTopology so that the
+// recursions never call GetTransitionScore. An entry state is the first
+// substate of a state outside of the initial path, which can be reached from
+// the final substate of any state (the exits). All transitions are floored
+// at zero_log and are also stored in the probability domain for the scaled
+// recursions.
+typedef struct
+{
+  std::vector<int> row;         // Row in the posteriorgram of each state.
+  std::vector<double> self;     // Self transition.
+  std::vector<double> previous; // Transition from the preceeding state. Not
+                                // used by entry states.
+  std::vector<int> entry_index; // Index into entry, or -1 if not an entry.
+  std::vector<int> exit_index;  // Index into exit, or -1 if not an exit.
+  std::vector<int> entry;       // Expanded index of each entry state.
+  std::vector<int> exit;        // Expanded index of each exit state.
+  utilities::Matrix<double> entry_transition; // (entry x exit)
+  utilities::Matrix<double> exit_transition;  // (exit x entry)
+  std::vector<bool> start;      // Valid states in the first frame.
+  std::vector<bool> end;        // Valid states in the final frame.
+  std::vector<double> self_prob, previous_prob;
+  utilities::Matrix<double> entry_prob, exit_prob;
+} ExpandedTopology;
+
 // Generates a transition matrix where the diagonal elements are self_loop_prob
 // and the off diagonal elements are (1-self_loop_prob). Assumes the 
 // probabilities are not in the log domain.
 utilities::Matrix<double> GenerateTransitionMatrix(
     unsigned int states, double self_loop_prob);
 
+// Generates a (state x max_frames) duration matrix for
+// FindSegmentalViterbiPath. A segment of d frames, between min_frames and
+// max_frames, has the log probability of taking the self loop d-1 times. Every
+// other duration is given zero_log. Assumes the probability is not in the log
+// domain.
+utilities::Matrix<double> GenerateDurationMatrix(unsigned int states,
+    unsigned int min_frames, unsigned int max_frames, double self_loop_prob);
+
 // Initial depracted version of the best path algorithm should be DELETED.
 std::vector<int> FindBestPath(const utilities::Matrix<double> &pgram, 
     const utilities::Matrix<double> &transition, int min_frames);
@@ -71,11 +158,101 @@ std::vector<int> FindRestrictedViterbiPath(
     const utilities::Matrix<double> &transition, int min_frames,                 
     std::vector<int> initial_path, bool force_align, double &final_score);
 
+// Same as FindViterbiPath and FindRestrictedViterbiPath, except the
+// posteriorgram is sparse and holds linear posteriors. The log state scores of
+// each frame are filled in from the stored entries as the frame is decoded,
+// and every posterior that is not stored is given the minimum state score.
+std::vector<int> FindViterbiPath(const statistics::SparsePosteriorgram &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    double &final_score);
+std::vector<int> FindRestrictedViterbiPath(
+    const statistics::SparsePosteriorgram &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    std::vector<int> initial_path, bool force_align, double &final_score);
+
+// Same as above for a quantized posteriorgram. Each frame is dequantized as it
+// is decoded.
+std::vector<int> FindViterbiPath(
+    const statistics::QuantizedPosteriorgram &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    double &final_score);
+std::vector<int> FindRestrictedViterbiPath(
+    const statistics::QuantizedPosteriorgram &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    std::vector<int> initial_path, bool force_align, double &final_score);
+
+// Same as FindRestrictedViterbiPath, except the full dynamic programming matrix
+// is never stored. A checkpoint of the scores is saved every interval frames
+// and the backpointers are recomputed one segment at a time. An interval of 0
+// uses sqrt(frames). Memory is O(states * (frames / interval + interval)).
+std::vector<int> FindCheckpointedViterbiPath(
+    const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align,
+    double &final_score, unsigned int interval = 0);
+
+// Returns up to n distinct paths in descending order of their score. Each
+// expanded state keeps at most n tokens per frame, and a token is only kept
+// for the best alignment of its state sequence. lattice is filled with the
+// prefix tree of the returned paths. Memory does not grow with the number of
+// frames since the lattice is pruned to the sequences still held by a token.
+std::vector<ScoredPath> FindNBestPaths(const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    unsigned int n, std::vector<LatticeNode> &lattice);
+
+// Computes the forward and backward probabilities over the expanded states.
+// occupancy is set to a (state x frame) matrix with the probability of being
+// in each original state at each frame and the log likelihood of the
+// posteriorgram is returned. If scaled is true, the recursions use scaled
+// probabilities, which avoids computing exp and log for every transition. If a
+// frame underflows, the log domain recursions are used instead.
+double ForwardBackward(const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align,
+    utilities::Matrix<double> &occupancy, bool scaled = false);
+
+// Returns only the log likelihood computed by the forward recursion. Only two
+// columns are kept in memory. The second version allows the topology to be
+// reused across many posteriorgrams with the same number of rows.
+double ForwardScore(const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align, 
+    bool scaled = false);
+double ForwardScore(const utilities::Matrix<double> &pgram,
+    const ExpandedTopology &topology, bool scaled = false);
+
+// Returns the same paths and scores as calling FindRestrictedViterbiPath on
+// every posteriorgram in pgram_set. Every posteriorgram must have the same
+// number of rows, but the number of frames may differ. Members that have run
+// out of frames are masked and keep their final scores. final_scores is set to
+// the score of each member.
+std::vector<std::vector<int> > BatchRestrictedViterbiPath(
+    const std::vector<utilities::Matrix<double> > &pgram_set,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align,
+    std::vector<double> &final_scores);
+
+// Finds the best sequence of segments. duration(s, d-1) is the log
+// probability of state s lasting exactly d frames, and durations with a log
+// probability at or below zero_log are not allowed. The transition matrix is
+// only used between different states. Every segment is scored in O(1) with a
+// cumulative sum of the posteriorgram, so the runtime is
+// O(states * frames * max duration + states^2 * frames). segment_start is set
+// to the first frame of each state in the path.
+std::vector<int> FindSegmentalViterbiPath(
+    const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition,
+    const utilities::Matrix<double> &duration, double &final_score,
+    std::vector<int> &segment_start);
+
 // Returns the one best path for a particular posteriorgram in the set that also
-// maximizes the likelihood for the entire set.
+// maximizes the likelihood for the entire set. If use_forward is true, the
+// likelihood of a path is the forward score of the path instead of the score
+// of the best alignment.
 std::vector<int> BestPathInSet(
     const std::vector<utilities::Matrix<double> > &pgram_set,
-    const utilities::Matrix<double> &transition, int min_frames);
+    const utilities::Matrix<double> &transition, int min_frames,
+    bool use_forward = false);
 
 // Returns the best single path for an entire set of posteriorgrams. The 
 // implementation is approximate, so the best path is not guaranteed.
@@ -83,6 +260,90 @@ std::vector<int> ApproximateViterbiSet(
     const std::vector<utilities::Matrix<double> > &pgram_set,
     const utilities::Matrix<double> &transition, int min_frames);
 
+// Fills column with the starting scores of every expanded state for the first
+// frame. Should only be used by functions internal to MultiBestPath.
+void ViterbiInitialColumn(const utilities::Matrix<double> &pgram,
+    const std::vector<int> &initial_path, int min_frames,
+    std::vector<ViterbiInfo> &column);
+
+// Computes the column of the dynamic programming matrix for frame given only
+// the scores of the previous frame. Should only be used by functions internal
+// to MultiBestPath.
+void ViterbiColumn(const utilities::Matrix<double> &pgram,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, unsigned int frame,
+    const std::vector<double> &previous, std::vector<ViterbiInfo> &column);
+
+// Maps an expanded state index back to the index of the original state.
+// Should only be used by functions internal to MultiBestPath.
+int OriginalState(const std::vector<int> &initial_path, int min_frames,
+    int state);
+
+// Returns the lattice node for sequence followed by state, adding it if it does
+// not exist. Should only be used by functions internal to MultiBestPath.
+int LatticeChild(std::map<std::pair<int, int>, int> &children,
+    std::vector<LatticeNode> &lattice, int sequence, int state);
+
+// Removes every lattice node that is not an ancestor of one of the tokens and
+// renumbers the sequences held by the tokens. Should only be used by functions
+// internal to MultiBestPath.
+void PruneLattice(std::vector<std::vector<ViterbiToken> > &tokens,
+    std::map<std::pair<int, int>, int> &children,
+    std::vector<LatticeNode> &lattice);
+
+// Sorts the tokens by score and keeps the best n with a distinct sequence.
+// Should only be used by functions internal to MultiBestPath.
+void KeepBestTokens(std::vector<ViterbiToken> &tokens, unsigned int n);
+
+// Internal functions used to sort tokens in descending order of score.
+inline bool CompareTokenScore(const ViterbiToken &a, const ViterbiToken &b){
+    return a.score > b.score; }
+inline bool CompareCandidateScore(const std::pair<ViterbiToken, bool> &a,
+    const std::pair<ViterbiToken, bool> &b){
+    return a.first.score > b.first.score; }
+
+// Builds the transition structure for a posteriorgram with the given number of
+// rows. If force_align is set, the states outside of initial_path are left out
+// since they can never reach the end of the path. Should only be used by
+// functions internal to MultiBestPath.
+ExpandedTopology BuildExpandedTopology(unsigned int rows,
+    const utilities::Matrix<double> &transition, int min_frames,
+    const std::vector<int> &initial_path, bool force_align);
+
+// Single steps of the forward and backward recursions in the log domain.
+// scores holds the log state likelihoods of the frame being computed (forward)
+// or of the following frame (backward). Should only be used by functions 
+// internal to MultiBestPath.
+void ForwardColumn(const ExpandedTopology &topology,
+    const std::vector<double> &scores, const std::vector<double> &previous,
+    std::vector<double> &current);
+void BackwardColumn(const ExpandedTopology &topology,
+    const std::vector<double> &scores, const std::vector<double> &next,
+    std::vector<double> &current);
+
+// Single steps of the scaled forward and backward recursions. likelihood holds
+// the state likelihoods scaled by the maximum in the frame. Returns the sum of
+// the new column before it is normalized. Should only be used by functions
+// internal to MultiBestPath.
+double ScaledForwardColumn(const ExpandedTopology &topology,
+    const std::vector<double> &likelihood, const std::vector<double> &previous,
+    std::vector<double> &current);
+void ScaledBackwardColumn(const ExpandedTopology &topology,
+    const std::vector<double> &likelihood, const std::vector<double> &next,
+    std::vector<double> &current);
+
+// Sets scores to the floored log state likelihood of every expanded state at
+// frame. Should only be used by functions internal to MultiBestPath.
+void ExpandedStateScores(const utilities::Matrix<double> &pgram,
+    const ExpandedTopology &topology, unsigned int frame,
+    std::vector<double> &scores);
+
+// Returns a (state x frame+1) matrix where element (s, f) is the sum of the
+// floored scores of state s in the frames before f. Should only be used by
+// functions internal to MultiBestPath.
+utilities::Matrix<double> CumulativeStateScores(
+    const utilities::Matrix<double> &pgram);
+
 // Handles the logic of determining the state likelihood. Should only be used 
 // by functions internal to MultiBestPath.
 double GetStateScore(const utilities::Matrix<double> &pgram,                     
@@ -106,6 +367,49 @@ std::vector<int> BestPathInDpMatrix(
     const std::vector<int> &initial_path, bool force_align, 
     double &final_score);
 
+// Runs the decoder of FindRestrictedViterbiPath on a compact posteriorgram with
+// rows states and frames frames. pgram only needs to provide
+// LogColumn(frame, floor, column), which fills the log state scores of a
+// frame. The frame is passed to the column functions as frame 0 of a one
+// column posteriorgram. Should only be used by functions internal to
+// MultiBestPath.
+template<class T>
+std::vector<int> ColumnRestrictedViterbiPath(const T &pgram, unsigned int rows,
+    unsigned int frames, const utilities::Matrix<double> &transition, 
+    int min_frames, const std::vector<int> &initial_path, bool force_align,
+    double &final_score)
+{
+  utilities::Matrix<ViterbiInfo> dp_matrix; // Holds the memoization data.
+  unsigned int states = (rows + initial_path.size()) * min_frames;
+  double minimum_log = -50;
+  std::vector<ViterbiInfo> column;
+  std::vector<double> previous(states);
+  utilities::Matrix<double> frame_scores(rows, 1);
+
+  ViterbiInfo default_value;
+  default_value.parent = -1;
+  default_value.score = -1000000;
+  dp_matrix.Initialize(states, frames, default_value);
+
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    pgram.LogColumn(f, minimum_log, frame_scores.data());
+    if(f == 0)
+      ViterbiInitialColumn(frame_scores, initial_path, min_frames, column);
+    else
+      ViterbiColumn(frame_scores, transition, min_frames, initial_path, 0,
+          previous, column);
+    for(unsigned int s = 0; s < states; ++s)
+    {
+      dp_matrix(s, f) = column[s];
+      previous[s] = column[s].score;
+    }
+  }
+
+  return BestPathInDpMatrix(dp_matrix, min_frames, initial_path, force_align, 
+      final_score);
+}
+
 }
 
 #endif
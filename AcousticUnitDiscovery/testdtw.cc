@@ -1,5 +1,6 @@
 #include "SpeechFeatures.h"
 #include "DynamicTimeWarp.h"
+#include "SparsePosteriorgram.h"
 #include "Matrix.h"
 #include <vector>
 #include <iostream>
@@ -56,6 +57,19 @@ for(int i = 0; i < 1; i++)
   //dtw.IncreaseSilenceCost(silence);
   dtw.PrunePathsByLCMA(50, 0.1);
   dtw.SaveResultAsPGM( std::string("result_pruned.pgm"));
+
+  // Repeat the search with only the top posteriors of each frame kept.
+  r1.Transpose();
+  r2.Transpose();
+  statistics::SparsePosteriorgram sparse1, sparse2;
+  sparse1.Initialize(r1, 5, false);
+  sparse2.Initialize(r2, 5, false);
+  acousticunitdiscovery::DynamicTimeWarp sparse_dtw;
+  sparse_dtw.ComputeSimilarityMatrix(sparse1, sparse2);
+  sparse_dtw.ComputeSegmentalDTW(20);
+  sparse_dtw.PrunePathsByLCMA(50, 0.1);
+  std::cout<<"Dense paths: "<<dtw.paths().size()<<" Sparse paths: "<<
+      sparse_dtw.paths().size()<<std::endl;
 }
   return 0;
 }
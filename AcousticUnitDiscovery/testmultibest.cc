@@ -60,6 +60,68 @@ int main()
   std::cout<<std::endl;
   std::cout<<score<<std::endl;
 
+  path = acousticunitdiscovery::FindCheckpointedViterbiPath(pgram_set[0],
+      transition, min_frames, initial_path, false, score);
+
+  for(unsigned int i = 0; i < path.size(); ++i)
+    std::cout<<path[i]<<" ";
+  std::cout<<std::endl;
+  std::cout<<score<<std::endl;
+
+  std::vector<acousticunitdiscovery::LatticeNode> lattice;
+  std::vector<acousticunitdiscovery::ScoredPath> nbest = 
+      acousticunitdiscovery::FindNBestPaths(pgram_set[0], transition, 
+      min_frames, 5, lattice);
+  for(unsigned int n = 0; n < nbest.size(); ++n)
+  {
+    std::cout<<nbest[n].score<<":";
+    for(unsigned int i = 0; i < nbest[n].path.size(); ++i)
+      std::cout<<" "<<nbest[n].path[i];
+    std::cout<<std::endl;
+  }
+  std::cout<<lattice.size()<<std::endl;
+
+  std::vector<int> segment_start;
+  utilities::Matrix<double> duration = 
+      acousticunitdiscovery::GenerateDurationMatrix(25, min_frames, 30, 0.9);
+  path = acousticunitdiscovery::FindSegmentalViterbiPath(pgram_set[0], 
+      transition, duration, score, segment_start);
+  for(unsigned int i = 0; i < path.size(); ++i)
+    std::cout<<path[i]<<"("<<segment_start[i]<<") ";
+  std::cout<<std::endl;
+  std::cout<<score<<std::endl;
+
+  // Decode the same posteriorgram after 16 bit log quantization.
+  utilities::Matrix<double> linear_pgram = pgram_set[0];
+  for(unsigned int r = 0; r < linear_pgram.NumRows(); ++r)
+    for(unsigned int c = 0; c < linear_pgram.NumCols(); ++c)
+      linear_pgram(r,c) = std::exp(linear_pgram(r,c));
+  statistics::QuantizedPosteriorgram quantized;
+  quantized.Initialize(linear_pgram, 16, statistics::LOG_QUANTIZATION);
+  path = acousticunitdiscovery::FindViterbiPath(quantized, transition,
+      min_frames, score);
+  for(unsigned int i = 0; i < path.size(); ++i)
+    std::cout<<path[i]<<" ";
+  std::cout<<std::endl;
+  std::cout<<score<<std::endl;
+
+  utilities::Matrix<double> occupancy;
+  score = acousticunitdiscovery::ForwardBackward(pgram_set[0], transition,
+      min_frames, initial_path, false, occupancy);
+  std::cout<<score<<std::endl;
+
+  path = acousticunitdiscovery::BestPathInSet(pgram_set, transition, 
+      min_frames);
+  for(unsigned int i = 0; i < path.size(); ++i)
+    std::cout<<path[i]<<" ";
+  std::cout<<std::endl;
+
+  path = acousticunitdiscovery::BestPathInSet(pgram_set, transition, 
+      min_frames, true);
+  for(unsigned int i = 0; i < path.size(); ++i)
+    std::cout<<path[i]<<" ";
+  std::cout<<std::endl;
+
   path = acousticunitdiscovery::ApproximateViterbiSet(pgram_set, transition, 
       min_frames);
 
@@ -0,0 +1,61 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#include "MappedFile.h"
+#include "sys/mman.h"
+#include "sys/stat.h"
+#include "fcntl.h"
+#include "unistd.h"
+
+namespace fileutilities
+{
+
+// mmap rejects a length of zero, so an empty file points at a static empty
+// string instead.
+bool MappedFile::Open(const std::string &filename, AccessPattern access)
+{
+  Close();
+  int descriptor = open(filename.c_str(), O_RDONLY);
+  if(descriptor < 0)
+    return false;
+  struct stat status;
+  if(fstat(descriptor, &status) != 0)
+  {
+    close(descriptor);
+    return false;
+  }
+  size_ = status.st_size;
+  if(size_ == 0)
+  {
+    close(descriptor);
+    data_ = "";
+    return true;
+  }
+  void *address = mmap(0, size_, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  // The mapping holds its own reference to the file.
+  close(descriptor);
+  if(address == MAP_FAILED)
+  {
+    size_ = 0;
+    return false;
+  }
+  if(access == RANDOM_ACCESS)
+    madvise(address, size_, MADV_RANDOM);
+  else if(access == PREFETCH_ACCESS)
+    madvise(address, size_, MADV_WILLNEED);
+  else
+    madvise(address, size_, MADV_SEQUENTIAL);
+  data_ = static_cast<const char*>(address);
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if(data_ != 0 && size_ > 0)
+    munmap(const_cast<char*>(data_), size_);
+  data_ = 0;
+  size_ = 0;
+}
+
+} // end namespace fileutilities
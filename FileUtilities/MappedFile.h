@@ -0,0 +1,78 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef FILEUTILITIES_MAPPEDFILE_H_
+#define FILEUTILITIES_MAPPEDFILE_H_
+
+#include<string>
+#include<ostream>
+#include<cstddef>
+
+namespace fileutilities
+{
+
+// How a mapping is expected to be read, passed to the kernel as madvise
+// advice. SEQUENTIAL_ACCESS suits a parser that walks the file once from the
+// start, RANDOM_ACCESS turns off read ahead, and PREFETCH_ACCESS starts
+// reading the whole file in for data that will all be touched soon.
+enum AccessPattern {SEQUENTIAL_ACCESS, RANDOM_ACCESS, PREFETCH_ACCESS};
+
+// A file mapped read only into memory. The contents are paged in by the
+// operating system as they are touched, so a large file can be parsed in place
+// without first being copied into a buffer. The mapping is released when the
+// object is destroyed or another file is opened. The contents are not NUL
+// terminated, so a parser must stop at data() + size().
+//
+// A binary file written with WriteAlignedArray can be read back in place with
+// Array. Every array starts on a 64 byte boundary of the file, and the
+// mapping starts on a page boundary, so the arrays are aligned in memory.
+class MappedFile
+{
+ private:
+  const char *data_;
+  size_t size_;
+
+ public:
+  MappedFile() : data_(0), size_(0) {}
+  ~MappedFile() { Close(); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Maps the whole file. Returns false if it cannot be opened or mapped. An
+  // empty file opens successfully with size() 0.
+  bool Open(const std::string &filename,
+      AccessPattern access = SEQUENTIAL_ACCESS);
+  void Close();
+
+  bool is_open() const { return data_ != 0; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // Returns the count values of T that start at offset rounded up to a
+  // multiple of 64 bytes, and moves offset past them. Returns 0 if they run
+  // past the end of the file.
+  template<class T> const T* Array(size_t &offset, size_t count) const
+  {
+    size_t start = ((offset + 63) / 64) * 64;
+    if(start > size_ || count > (size_ - start) / sizeof(T))
+      return 0;
+    offset = start + count * sizeof(T);
+    return reinterpret_cast<const T*>(data_ + start);
+  }
+};
+
+// Pads out with zeros to a multiple of 64 bytes from the start of the file and
+// writes count values, to be read back with MappedFile::Array.
+template<class T> void WriteAlignedArray(std::ostream &out, const T *values,
+    size_t count)
+{
+  static const char zeros[64] = {0};
+  std::streamoff position = out.tellp();
+  out.write(zeros, (64 - position % 64) % 64);
+  if(count > 0)
+    out.write(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+} // end namespace fileutilities
+#endif
@@ -101,6 +101,8 @@ bool SpeechFeatures::WriteHtkFile(std::string filename)
 {
   std::ofstream fout;
   fout.open(filename.c_str(), std::ios::out|std::ios::binary);
+  if( !fout.is_open() )
+    return false;
   
   HtkFileHeader header;
   header.number_of_samples = features_[0].NumRows();
@@ -123,7 +125,7 @@ bool SpeechFeatures::WriteHtkFile(std::string filename)
     }
 
   fout.close();
-  return true;
+  return !fout.fail();
 }
 
 void SpeechFeatures::Initialize(std::vector<std::vector<double> > record)
@@ -0,0 +1,50 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+// Converts an HTK model into the binary format of HmmSet, which the other
+// tools load without parsing. The compiled file is read back and checked
+// against the original before the program reports success.
+
+#include<cstdlib>
+#include<iostream>
+#include<vector>
+#include<string>
+
+#include "HmmSet.h"
+
+int main(int argc, char* argv[])
+{
+  if( argc < 3)
+  {
+    std::cout<<"Usage is <HMM File> <Output Compiled File>"<<std::endl;
+    exit(0);
+  }
+  std::string hmmfile = std::string(argv[1]);
+  std::string outfile = std::string(argv[2]);
+
+  statistics::HmmSet htk;
+  if(!htk.LoadHmmSet(hmmfile))
+  {
+    std::cout<<"File "<<hmmfile<<" could not be opened.\n";
+    exit(1);
+  }
+  if(!htk.WriteCompiledHmmSet(outfile))
+  {
+    std::cout<<"File "<<outfile<<" could not be written.\n";
+    exit(1);
+  }
+
+  statistics::HmmSet compiled;
+  if(!compiled.LoadCompiledHmmSet(outfile) || 
+      compiled.NumberOfGaussians() != htk.NumberOfGaussians() ||
+      compiled.mixture_names() != htk.mixture_names() ||
+      compiled.hmms().size() != htk.hmms().size())
+  {
+    std::cout<<"File "<<outfile<<" does not match "<<hmmfile<<".\n";
+    exit(1);
+  }
+  std::cout<<"States: "<<htk.states().size()<<" Gaussians: "<<
+      htk.NumberOfGaussians()<<" HMMs: "<<htk.hmms().size()<<std::endl;
+  return 0;
+}
@@ -0,0 +1,102 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+// Reduces the size of an HTK model by merging Gaussians within each state
+// whose symmetric KL divergence is below a threshold. The merged model is
+// written back out in the HTK format. If a list of feature files is given, the
+// posteriorgrams of the original and the merged model are compared on them so
+// the cost of the reduction can be judged.
+
+#include<cmath>
+#include<cstdlib>
+#include<iostream>
+#include<fstream>
+#include<vector>
+#include<string>
+#include<algorithm>
+
+#include "Matrix.h"
+#include "SpeechFeatures.h"
+#include "PosteriorgramGenerator.h"
+#include "StringFunctions.h"
+#include "HmmSet.h"
+
+int main(int argc, char* argv[])
+{
+  if( argc < 4)
+  {
+    std::cout<<"Usage is <HMM File> <KL Threshold> <Output HMM File>"<<
+        " [Feature File List]"<<std::endl;
+    exit(0);
+  }
+  std::string hmmfile = std::string(argv[1]);
+  double threshold = utilities::ToNumber<double>(std::string(argv[2]));
+  std::string outfile = std::string(argv[3]);
+
+  statistics::HmmSet htk;
+  if(!htk.LoadHmmSet(hmmfile))
+  {
+    std::cout<<"File "<<hmmfile<<" could not be opened.\n";
+    exit(1);
+  }
+  std::vector<statistics::MixtureOfDiagonalGaussians> original = htk.states();
+  unsigned int before = htk.NumberOfGaussians();
+  unsigned int merges = htk.MergeSimilarGaussians(threshold);
+  std::cout<<"States: "<<original.size()<<" Gaussians: "<<before<<" -> "<<
+      htk.NumberOfGaussians()<<" ("<<merges<<" merges)"<<std::endl;
+  if( !htk.WriteHtkHmmSet(outfile) )
+  {
+    std::cout<<"File "<<outfile<<" could not be written.\n";
+    exit(1);
+  }
+  if( argc < 5)
+    return 0;
+
+  // Compare the state posteriorgrams of both models on every file.
+  statistics::PosteriorgramGenerator full, merged;
+  full.SetGaussians(original);
+  merged.SetGaussians(htk.states());
+  std::ifstream fin(argv[4]);
+  double total_error = 0, max_error = 0, elements = 0;
+  unsigned int frames = 0, agree = 0;
+  while(fin.good())
+  {
+    std::string line;
+    std::getline(fin, line);
+    line = utilities::TrimString(line);
+    if(line.length() == 0)
+      continue;
+    fileutilities::SpeechFeatures sf;
+    if(!sf.ReadHtkFile(line) || sf.num_frames(0) == 0)
+    {
+      std::cerr<<"Could not read "<<line<<std::endl;
+      continue;
+    }
+    utilities::Matrix<double> data = sf.record(0);
+    data.Transpose();
+    utilities::Matrix<double> a = full.ComputePosteriorgram(data);
+    utilities::Matrix<double> b = merged.ComputePosteriorgram(data);
+    std::vector<int> best_a = full.BestIndexPerFrame(a);
+    std::vector<int> best_b = merged.BestIndexPerFrame(b);
+    for(unsigned int f = 0; f < a.NumCols(); ++f)
+    {
+      for(unsigned int r = 0; r < a.NumRows(); ++r)
+      {
+        double error = std::abs(a(r,f) - b(r,f));
+        total_error += error;
+        max_error = std::max(max_error, error);
+      }
+      if(best_a[f] == best_b[f])
+        agree++;
+    }
+    elements += static_cast<double>(a.NumRows()) * a.NumCols();
+    frames += a.NumCols();
+  }
+  if(frames > 0)
+    std::cout<<"Frames: "<<frames<<" mean posterior change: "<<
+        (total_error / elements)<<" max: "<<max_error<<
+        " one-best agreement: "<<(static_cast<double>(agree) / frames)<<
+        std::endl;
+  return 0;
+}
@@ -7,14 +7,30 @@
 namespace statistics
 {
 
-void DiagonalGaussian::Initialize(std::vector<double> mean, 
-    std::vector<double> variance)
+void DiagonalGaussian::Initialize(const std::vector<double> &mean, 
+    const std::vector<double> &variance)
 {
   mean_ = mean;
   variance_ = variance;
   CalculateConstant();
 }
 
+void DiagonalGaussian::Initialize(std::vector<double> &&mean, 
+    std::vector<double> &&variance)
+{
+  mean_ = std::move(mean);
+  variance_ = std::move(variance);
+  CalculateConstant();
+}
+
+void DiagonalGaussian::Initialize(const double *mean, const double *variance,
+    unsigned int dimension)
+{
+  mean_.assign(mean, mean + dimension);
+  variance_.assign(variance, variance + dimension);
+  CalculateConstant();
+}
+
 void DiagonalGaussian::CalculateConstant()
 {
   double pi = 4.0 * atan(1.0); // Standard method of calculating pi.
@@ -22,52 +38,119 @@ void DiagonalGaussian::CalculateConstant()
   for(unsigned int i =0; i < variance_.size(); ++i)
     constant_ *= variance_[i];
   constant_ = 1 / (std::sqrt(constant_) * std::pow(2*pi, mean_.size() / 2.0));
+
+  // Values used by the log domain evaluation.
+  log_constant_ = mean_.size() * std::log(2*pi);
+  inverse_variance_.resize(variance_.size());
+  for(unsigned int i = 0; i < variance_.size(); ++i)
+  {
+    log_constant_ += std::log(variance_[i]);
+    inverse_variance_[i] = 1 / variance_[i];
+  }
+  log_constant_ = -0.5 * log_constant_;
 }
 
-void DiagonalGaussian::AddMean(std::vector<double> mean)
+void DiagonalGaussian::AddMean(const std::vector<double> &mean)
 {
-  for(unsigned int i = 0; i < mean.size(); ++i)
+  AddMean(&mean[0]);
+}
+
+void DiagonalGaussian::AddMean(const double *mean)
+{
+  for(unsigned int i = 0; i < mean_.size(); ++i)
     mean_[i] += mean[i];
   CalculateConstant();
 }
 
-void DiagonalGaussian::AddVariance(std::vector<double> variance)
+void DiagonalGaussian::AddVariance(const std::vector<double> &variance)
+{
+  AddVariance(&variance[0]);
+}
+
+void DiagonalGaussian::AddVariance(const double *variance)
 {
-  for(unsigned int i = 0; i < variance.size(); ++i)
+  for(unsigned int i = 0; i < variance_.size(); ++i)
     variance_[i] += variance[i];
   CalculateConstant();
 }
 
-double DiagonalGaussian::Likelihood(std::vector<double> point) const
+double DiagonalGaussian::Likelihood(const std::vector<double> &point) const
+{
+  return Likelihood(&point[0]);
+}
+
+double DiagonalGaussian::Likelihood(const double *point) const
 {
   double result = 0;
-  for(unsigned int i =0; i < point.size(); ++i)
+  for(unsigned int i =0; i < mean_.size(); ++i)
     result += pow(mean_[i] - point[i],2.0) / (variance_[i]);
 
   result = constant_ *  std::exp(-0.5 * result);
   return result;
 }
 
-double DiagonalGaussian::LogLikelihood(std::vector<double> point) const
+double DiagonalGaussian::LogLikelihood(const std::vector<double> &point) const
+{
+  return LogLikelihood(&point[0]);
+}
+
+// The sum is split into four independent partial sums so the compiler can
+// vectorize the loop without reordering a single floating point reduction.
+double DiagonalGaussian::LogLikelihood(const double *point) const
+{
+  unsigned int dimension = mean_.size();
+  const double *mean = &mean_[0];
+  const double *inverse_variance = &inverse_variance_[0];
+  double sum[4] = {0, 0, 0, 0};
+  unsigned int i = 0;
+  for(; i + 4 <= dimension; i += 4)
+    for(unsigned int j = 0; j < 4; ++j)
+    {
+      double difference = point[i+j] - mean[i+j];
+      sum[j] += difference * difference * inverse_variance[i+j];
+    }
+  for(; i < dimension; ++i)
+  {
+    double difference = point[i] - mean[i];
+    sum[0] += difference * difference * inverse_variance[i];
+  }
+  return log_constant_ - 0.5 * ((sum[0] + sum[1]) + (sum[2] + sum[3]));
+}
+
+// Follows CalculateConstant and Likelihood on the summed variances, so the
+// result matches the copying version.
+double DiagonalGaussian::ProductIntegral(const DiagonalGaussian &g) const
 {
-  return std::log(Likelihood(point));
+  double pi = 4.0 * atan(1.0);
+  double result = 0, determinant = 1;
+  for(unsigned int i = 0; i < mean_.size(); ++i)
+  {
+    double variance = g.variance_[i] + variance_[i];
+    result += pow(g.mean_[i] - mean_[i], 2.0) / variance;
+    determinant *= variance;
+  }
+  double constant = 1 / (std::sqrt(determinant) * 
+      std::pow(2*pi, mean_.size() / 2.0));
+  return constant * std::exp(-0.5 * result);
 }
 
-double DiagonalGaussian::KLDivergence(DiagonalGaussian g)
+// The log of the determinant ratio is a sum of logs, since the product of the
+// variance ratios can overflow or underflow in high dimensions.
+double DiagonalGaussian::KLDivergence(const DiagonalGaussian &g) const
 {
   double ret = 0;
-  double det_term = 1;
+  double log_det_term = 0;
   for(unsigned int i = 0; i < mean_.size(); ++i)
   {
-    ret += variance_[i] / g.variance(i);
-    ret += pow(g.mean(i) - mean_[i], 2.0) / g.variance(i);
-    det_term *= (variance_[i] / g.variance(i));
+    ret += variance_[i] * g.inverse_variance_[i];
+    ret += pow(g.mean(i) - mean_[i], 2.0) * g.inverse_variance_[i];
+    log_det_term += std::log(variance_[i]) - std::log(g.variance(i));
   }
-  ret = 0.5 * (ret - std::log(det_term) - dimension());
+  ret = 0.5 * (ret - log_det_term - dimension());
   return ret;
 }
 
-double DiagonalGaussian::SymmetricKLDivergence(DiagonalGaussian g)
+double DiagonalGaussian::SymmetricKLDivergence(const DiagonalGaussian &g) const
 {
   return KLDivergence(g) + g.KLDivergence(*this);
 }
@@ -84,13 +167,10 @@ double DiagonalGaussian::determinant() const
 std::vector<double> DiagonalGaussian::Sample( 
     std::default_random_engine &generator) const
 {
-  std::vector<double> ret;
+  std::normal_distribution<double> distribution(0.0, 1.0);
+  std::vector<double> ret(mean_.size());
   for(unsigned int i = 0; i < mean_.size(); ++i)
-  {
-    std::normal_distribution<double> distribution(
-        mean_[i],std::sqrt(variance_[i]));
-    ret.push_back(distribution(generator));
-  }
+    ret[i] = mean_[i] + std::sqrt(variance_[i]) * distribution(generator);
   return ret;
 }
 
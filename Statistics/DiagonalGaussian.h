@@ -8,6 +8,7 @@
 #include <vector>
 #include <cmath>
 #include <random>
+#include <utility>
 
 // Stores the information needed for a Gaussian with diagonal variance. Both the
 // likelihood and log likelihood of the Gaussian can be evaluated. KL divergence
@@ -21,35 +22,61 @@ class DiagonalGaussian
   DiagonalGaussian(){}
   ~DiagonalGaussian(){}
 
-  // Creates the Gaussian given a mean and variance vector.
-  void Initialize(std::vector<double> mean, std::vector<double> variance);
+  // Creates the Gaussian given a mean and variance vector. The rvalue version
+  // takes ownership of the vectors instead of copying them. The pointer version
+  // reads dimension values from each array and reuses the existing storage.
+  void Initialize(const std::vector<double> &mean,
+      const std::vector<double> &variance);
+  void Initialize(std::vector<double> &&mean, std::vector<double> &&variance);
+  void Initialize(const double *mean, const double *variance,
+      unsigned int dimension);
 
   // Calculates the normalization constant used determining the likelihood.
   void CalculateConstant();
 
-  // Adds a vector of values to the mean vector of the Gaussian.
-  void AddMean(std::vector<double> mean);
+  // Adds a vector of values to the mean vector of the Gaussian. The pointer
+  // version reads dimension() values.
+  void AddMean(const std::vector<double> &mean);
+  void AddMean(const double *mean);
 
-  // Adds a vector of values to the variance vector of the Gaussian.
-  void AddVariance(std::vector<double> variance);
+  // Adds a vector of values to the variance vector of the Gaussian. The pointer
+  // version reads dimension() values.
+  void AddVariance(const std::vector<double> &variance);
+  void AddVariance(const double *variance);
 
   // Returns the likelihood of the point given the Gaussian. The dimension of
   // point must be equally to the dimension of the Gaussian.
-  double Likelihood(std::vector<double> point) const;
-  double LogLikelihood(std::vector<double> point) const;
+  double Likelihood(const std::vector<double> &point) const;
+  double Likelihood(const double *point) const;
+  double LogLikelihood(const std::vector<double> &point) const;
+
+  // Evaluates the log likelihood directly in the log domain using the
+  // precomputed inverse variances and log normalization constant. Unlike
+  // log(Likelihood(point)), the result does not underflow for points far from
+  // the mean. point must contain dimension() values.
+  double LogLikelihood(const double *point) const;
+
+  // Integral of the product of this Gaussian and g, which is the likelihood of
+  // this mean under g with the variances of both added together. Gives the same
+  // result as copying g, calling AddVariance, and evaluating Likelihood, but
+  // without the copy.
+  double ProductIntegral(const DiagonalGaussian &g) const;
 
   // KL Divergence is a measure of the distance between two Gaussian
-  // distributions.
-  double KLDivergence(DiagonalGaussian g);          // I believe these functions
-  double SymmetricKLDivergence(DiagonalGaussian g); // are correct, but they
-                                                    // should be tested more.
+  // distributions. I believe these functions are correct, but they should be
+  // tested more.
+  double KLDivergence(const DiagonalGaussian &g) const;
+  double SymmetricKLDivergence(const DiagonalGaussian &g) const;
 
   // Standard accessor functions.
   unsigned int dimension() const{ return mean_.size();}
   double mean(unsigned int i) const { return mean_[i];}
   double variance(unsigned int i) const {return variance_[i];}
-  std::vector<double> mean() const {return mean_;}
-  std::vector<double> variance() const {return variance_;}
+  double log_constant() const {return log_constant_;}
+  const std::vector<double>& mean() const {return mean_;}
+  const std::vector<double>& variance() const {return variance_;}
+  const double* mean_data() const {return &mean_[0];}
+  const double* variance_data() const {return &variance_[0];}
   
   // Returns the determinant of the diagonal covariance matrix.
   double determinant() const;
@@ -63,6 +90,10 @@ class DiagonalGaussian
   std::vector<double> variance_; // Since the Gaussian has a digaonal covariance
                                  // matrix, it can be stored as a vector.
   double constant_; // standard Gaussian normalization term
+  std::vector<double> inverse_variance_; // 1 / variance_, used by the log
+                                         // domain evaluation.
+  double log_constant_; // log of constant_, computed from a sum of logs so it
+                        // does not overflow for high dimensions.
 };
 
 }
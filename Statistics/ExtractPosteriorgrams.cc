@@ -0,0 +1,274 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+// Converts every feature file in a list into a posteriorgram stored as an HTK
+// file. Reading, scoring, and writing run as a pipeline. One thread reads the
+// features, a pool of workers computes the posteriorgrams, and one thread
+// writes the results. The stages are connected by bounded queues, so only a few
+// utterances are held in memory at once. Outputs that already exist are skipped
+// so an interrupted run can be resumed.
+
+#include<cstdio>
+#include<cstdlib>
+#include<iostream>
+#include<fstream>
+#include<vector>
+#include<string>
+#include<deque>
+#include<set>
+#include<utility>
+#include<functional>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+
+#include "Matrix.h"
+#include "SpeechFeatures.h"
+#include "PosteriorgramGenerator.h"
+#include "StringFunctions.h"
+#include "HmmSet.h"
+
+// Settings taken from the command line.
+typedef struct
+{
+  std::string hmmfile;
+  std::string cluster_file;
+  std::string file_list;
+  std::string outdir;
+  unsigned int threads;
+  unsigned int queue_size;
+  bool skip_existing;
+} ExtractionParameters;
+
+// A single utterance as it moves through the pipeline. data is the features
+// (feature x frame) after reading and the posteriorgram (frame x posterior)
+// after scoring.
+typedef struct
+{
+  unsigned int index;
+  std::string input;
+  std::string output;
+  utilities::Matrix<double> data;
+} ExtractionJob;
+
+// A first in, first out queue shared between threads. Push blocks while the
+// queue is full and Pop blocks while it is empty. Once Close has been called,
+// Pop returns false after the remaining items are consumed.
+class JobQueue
+{
+ private:
+  std::deque<ExtractionJob> jobs_;
+  unsigned int capacity_;
+  bool closed_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+
+ public:
+  JobQueue(unsigned int capacity) : capacity_(capacity), closed_(false) {}
+
+  void Push(ExtractionJob &job)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(jobs_.size() >= capacity_)
+      not_full_.wait(lock);
+    jobs_.push_back(ExtractionJob());
+    std::swap(jobs_.back(), job);
+    not_empty_.notify_one();
+  }
+
+  bool Pop(ExtractionJob &job)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(jobs_.empty() && !closed_)
+      not_empty_.wait(lock);
+    if(jobs_.empty())
+      return false;
+    std::swap(job, jobs_.front());
+    jobs_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void Close()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+};
+
+bool FileExists(const std::string &filename)
+{
+  std::ifstream fin(filename.c_str());
+  return fin.good();
+}
+
+// The output name is the input file name without its directory or its last
+// extension, so /data/spk1.utt1.htk becomes <outdir>/spk1.utt1.pgram. Inputs in
+// different directories can still share a name, which ReadStage rejects.
+std::string OutputFilename(const std::string &input, const std::string &outdir)
+{
+  std::string name = input;
+  size_t slash = name.find_last_of('/');
+  if(slash != std::string::npos)
+    name = name.substr(slash + 1);
+  size_t dot = name.find_last_of('.');
+  if(dot != std::string::npos && dot > 0)
+    name = name.substr(0, dot);
+  return outdir + "/" + name + ".pgram";
+}
+
+// Reads each file in the list and passes it to the scoring queue. Jobs keep
+// their position in the list so the writer can report progress. A file whose
+// output name was already used is skipped rather than overwriting the earlier
+// posteriorgram.
+void ReadStage(const ExtractionParameters &param, JobQueue &score_queue)
+{
+  std::ifstream fin;
+  fin.open(param.file_list.c_str());
+  std::set<std::string> outputs;
+  unsigned int index = 0;
+  while(fin.good())
+  {
+    std::string line;
+    std::getline(fin, line);
+    line = utilities::TrimString(line);
+    if(line.length() == 0)
+      continue;
+    ExtractionJob job;
+    job.index = index++;
+    job.input = line;
+    job.output = OutputFilename(line, param.outdir);
+    if(!outputs.insert(job.output).second)
+    {
+      std::cerr<<"Skipping "<<job.input<<" since "<<job.output<<
+          " is already the output of an earlier file."<<std::endl;
+      continue;
+    }
+    if(param.skip_existing && FileExists(job.output))
+      continue;
+    fileutilities::SpeechFeatures sf;
+    if(!sf.ReadHtkFile(job.input) || sf.num_frames(0) == 0)
+    {
+      std::cerr<<"Could not read "<<job.input<<std::endl;
+      continue;
+    }
+    job.data = sf.record(0);
+    job.data.Transpose();
+    score_queue.Push(job);
+  }
+  score_queue.Close();
+}
+
+void ScoreStage(const statistics::PosteriorgramGenerator &pg,
+    JobQueue &score_queue, JobQueue &write_queue)
+{
+  ExtractionJob job;
+  while(score_queue.Pop(job))
+  {
+    job.data = pg.ComputePosteriorgram(job.data);
+    job.data.Transpose();
+    write_queue.Push(job);
+  }
+}
+
+// Each posteriorgram is written to a temporary file and renamed into place,
+// so a run that is interrupted never leaves a partial output that a resumed
+// run would skip.
+void WriteStage(JobQueue &write_queue, unsigned int &written)
+{
+  ExtractionJob job;
+  while(write_queue.Pop(job))
+  {
+    fileutilities::SpeechFeatures pgram;
+    pgram.Initialize(job.data);
+    std::string temporary = job.output + ".tmp";
+    if(!pgram.WriteHtkFile(temporary) ||
+        std::rename(temporary.c_str(), job.output.c_str()) != 0)
+    {
+      std::cerr<<"Could not write "<<job.output<<std::endl;
+      std::remove(temporary.c_str());
+      continue;
+    }
+    written++;
+    std::cout<<job.index<<": "<<job.output<<std::endl;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc < 5)
+  {
+    std::cout<<"Usage is <HMM File> <Cluster Index> <File List>"<<
+        " <Output Directory> [Threads] [Queue Size] [Skip Existing (0/1)]"<<
+        std::endl;
+    exit(0);
+  }
+  ExtractionParameters param;
+  param.hmmfile = std::string(argv[1]);
+  param.cluster_file = std::string(argv[2]);
+  param.file_list = std::string(argv[3]);
+  param.outdir = std::string(argv[4]);
+  param.threads = std::thread::hardware_concurrency();
+  param.queue_size = 0;
+  param.skip_existing = true;
+  if(argc > 5)
+    param.threads = utilities::ToNumber<unsigned int>(std::string(argv[5]));
+  if(argc > 6)
+    param.queue_size = utilities::ToNumber<unsigned int>(std::string(argv[6]));
+  if(argc > 7)
+    param.skip_existing = utilities::ToNumber<int>(std::string(argv[7])) != 0;
+  if(param.threads == 0)
+    param.threads = 1;
+  if(param.queue_size == 0)
+    param.queue_size = 2 * param.threads;
+
+  if(!FileExists(param.file_list))
+  {
+    std::cout<<"File "<<param.file_list<<" could not be opened.\n";
+    exit(1);
+  }
+
+  statistics::HmmSet htk;
+  if(!htk.LoadHmmSet(param.hmmfile))
+  {
+    std::cout<<"File "<<param.hmmfile<<" could not be opened.\n";
+    exit(1);
+  }
+  std::vector<statistics::MixtureOfDiagonalGaussians> mog = htk.states();
+  std::vector<int> cluster_index;
+  if(!utilities::ReadIndexFile(param.cluster_file, cluster_index))
+  {
+    std::cout<<"File "<<param.cluster_file<<" could not be read.\n";
+    exit(1);
+  }
+  if(mog.size() == 0 || cluster_index.size() != mog.size())
+  {
+    std::cout<<"The cluster index has "<<cluster_index.size()<<
+        " entries but the model has "<<mog.size()<<" states.\n";
+    exit(1);
+  }
+  statistics::PosteriorgramGenerator pg;
+  pg.SetGaussians(mog, cluster_index);
+  pg.AggregateClusters();
+
+  JobQueue score_queue(param.queue_size), write_queue(param.queue_size);
+  unsigned int written = 0;
+  std::thread reader(ReadStage, std::cref(param), std::ref(score_queue));
+  std::thread writer(WriteStage, std::ref(write_queue), std::ref(written));
+  std::vector<std::thread> workers;
+  for(unsigned int t = 0; t < param.threads; ++t)
+    workers.push_back(std::thread(ScoreStage, std::cref(pg),
+        std::ref(score_queue), std::ref(write_queue)));
+
+  reader.join();
+  for(unsigned int t = 0; t < workers.size(); ++t)
+    workers[t].join();
+  write_queue.Close();
+  writer.join();
+
+  std::cout<<"Wrote "<<written<<" posteriorgrams."<<std::endl;
+  return 0;
+}
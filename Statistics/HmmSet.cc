@@ -2,16 +2,25 @@
 // This is free and unencumbered software released into the public domain.
 // See the UNLICENSE file for more information.
 #include "HmmSet.h"
+#include "MappedFile.h"
+#include<cstring>
+#include<cstdlib>
 
 namespace statistics
 {
 
 void HmmSet::LoadHtkHmmSet(std::string filename)
 {
+  UnpackStates();
   std::ifstream fin(filename.c_str(), std::ios::in);
   std::string line;
   //std::cout<<filename<<std::endl;
 
+  // Keep everything before the first model definition.
+  header_.clear();
+  while(std::getline(fin, line) && !IsHtkModelHeader(line))
+    header_.push_back(line);
+
   while(FindHtkModelHeader(fin, line)) // For each HMM in the file.
   {
     // Read in each state within the HMM.
@@ -28,6 +37,19 @@ void HmmSet::LoadHtkHmmSet(std::string filename)
   }
 
   fin.close();
+  packed_states_.Initialize(states_);
+}
+
+// Either ~h or ~s marks the beginning of either an HMM or state definition.
+bool HmmSet::IsHtkModelHeader(const std::string &line)
+{
+  return IsHtkModelHeader(line.data(), line.data() + line.length());
+}
+
+bool HmmSet::IsHtkModelHeader(const char *line, const char *line_end)
+{
+  return line_end - line > 4 && (std::strncmp(line, "~s \"", 4) == 0 ||
+      std::strncmp(line, "~h \"", 4) == 0);
 }
 
 // Looks for either ~h or ~s which marks the beginning of either an HMM or state
@@ -36,11 +58,8 @@ bool HmmSet::FindHtkModelHeader(std::ifstream &fin, std::string &line)
 {
   while( fin.good() )
   {
-    if(line.length() > 4 && (line.substr(0,4) == std::string("~s \"") || 
-        line.substr(0,4) == std::string("~h \"")))
-    {
+    if(IsHtkModelHeader(line))
       return true;
-    }
     std::getline(fin, line);
   }
   return false;
@@ -161,17 +180,301 @@ DiagonalGaussian HmmSet::LoadSingleHtkGaussian(std::ifstream &fin,
   utilities::TokenizeString(line, ' ', tokens);
   for(unsigned int i = 0; i < tokens.size(); ++i)
     variance.push_back(utilities::ToNumber<double>(tokens[i]));
-  g.Initialize(mean, variance);
+  g.Initialize(std::move(mean), std::move(variance));
   getline(fin, line); // Skip GCONST line
   getline(fin, line);
 
   return g;
 }
 
+// The helpers below read a line of a mapped file the way TrimString followed
+// by TokenizeString with a space delimiter splits a std::string, and parse a
+// token the way ToNumber does, without building any strings.
+static bool HtkLineStartsWith(const char *line, const char *line_end,
+    const char *prefix)
+{
+  size_t length = std::strlen(prefix);
+  return static_cast<size_t>(line_end - line) >= length &&
+      std::strncmp(line, prefix, length) == 0;
+}
+
+static bool HtkLineContains(const char *line, const char *line_end,
+    const char *word)
+{
+  return std::search(line, line_end, word, word + std::strlen(word)) != 
+      line_end;
+}
+
+// Name of a ~s or ~h macro line, taken as line.substr(4, length-5).
+static std::string HtkMacroName(const char *line, const char *line_end)
+{
+  return std::string(line + 4, line_end - 1);
+}
+
+static bool IsHtkSpace(char c)
+{
+  return c == ' ' || c == '\f' || c == '\n' || c == '\r' || c == '\t' ||
+      c == '\v';
+}
+
+// Moves position past the next token of [position, end) and returns the token
+// in [token, token_end). Returns false if there are no more tokens.
+static bool NextHtkToken(const char *&position, const char *end,
+    const char *&token, const char *&token_end)
+{
+  while(position < end && *position == ' ')
+    ++position;
+  if(position == end)
+    return false;
+  token = position;
+  while(position < end && *position != ' ')
+    ++position;
+  token_end = position;
+  return true;
+}
+
+// Removes surrounding white space from [begin, end).
+static void TrimHtkLine(const char *&begin, const char *&end)
+{
+  while(begin < end && IsHtkSpace(*begin))
+    ++begin;
+  while(end > begin && IsHtkSpace(*(end - 1)))
+    --end;
+}
+
+// Returns token index of the line in [token, token_end), or false if the line
+// has fewer tokens.
+static bool HtkToken(const char *line, const char *line_end, 
+    unsigned int index, const char *&token, const char *&token_end)
+{
+  TrimHtkLine(line, line_end);
+  for(unsigned int i = 0; i <= index; ++i)
+    if(!NextHtkToken(line, line_end, token, token_end))
+      return false;
+  return true;
+}
+
+static void HtkStringToNumber(const char *buffer, double &value) {
+    value = std::strtod(buffer, 0); }
+static void HtkStringToNumber(const char *buffer, float &value) {
+    value = std::strtof(buffer, 0); }
+static void HtkStringToNumber(const char *buffer, unsigned int &value) {
+    value = static_cast<unsigned int>(std::strtoul(buffer, 0, 10)); }
+
+// The token is copied to the stack so the conversion stops before the end of
+// the mapping. Numbers in an HTK file are far shorter than the buffer.
+template<typename T> static T ParseHtkNumber(const char *token,
+    const char *token_end)
+{
+  char buffer[64];
+  size_t length = std::min<size_t>(token_end - token, sizeof(buffer) - 1);
+  std::memcpy(buffer, token, length);
+  buffer[length] = '\0';
+  T value;
+  HtkStringToNumber(buffer, value);
+  return value;
+}
+
+// Value of token index of the line, or 0 if it is missing.
+template<typename T> static T HtkNumber(const char *line, const char *line_end,
+    unsigned int index)
+{
+  const char *token, *token_end;
+  if(!HtkToken(line, line_end, index, token, token_end))
+    return 0;
+  return ParseHtkNumber<T>(token, token_end);
+}
+
+// Appends every token of the line to values.
+static void HtkValues(const char *line, const char *line_end,
+    std::vector<double> &values)
+{
+  const char *token, *token_end;
+  TrimHtkLine(line, line_end);
+  while(NextHtkToken(line, line_end, token, token_end))
+    values.push_back(ParseHtkNumber<double>(token, token_end));
+}
+
+bool HmmSet::LoadMappedHtkHmmSet(std::string filename)
+{
+  fileutilities::MappedFile file;
+  if(!file.Open(filename))
+    return false;
+  UnpackStates();
+  HtkText text;
+  text.position = file.data();
+  text.end = file.data() + file.size();
+  text.line = text.line_end = text.position;
+  text.good = true;
+
+  // Keep everything before the first model definition.
+  header_.clear();
+  while(NextHtkLine(text) && !IsHtkModelHeader(text.line, text.line_end))
+    header_.push_back(std::string(text.line, text.line_end));
+
+  while(FindHtkModelHeader(text)) // For each HMM in the file.
+  {
+    // Read in each state within the HMM.
+    if(HtkLineStartsWith(text.line, text.line_end, "~s \""))
+    {
+      std::string name = HtkMacroName(text.line, text.line_end);
+      NextHtkLine(text);
+      LoadSingleHtkState(text, name);
+    }
+    else
+    {
+      LoadSingleHtkHmm(text);
+    }
+  }
+  packed_states_.Initialize(states_);
+  return true;
+}
+
+// Reading past the last line leaves an empty line, so the loops that search
+// for a keyword end at the end of the file.
+bool HmmSet::NextHtkLine(HtkText &text)
+{
+  if(text.position >= text.end)
+  {
+    text.line = text.line_end = text.end;
+    text.good = false;
+    return false;
+  }
+  const char *newline = static_cast<const char*>(std::memchr(text.position, 
+      '\n', text.end - text.position));
+  text.line = text.position;
+  if(newline != 0)
+  {
+    text.line_end = newline;
+    text.position = newline + 1;
+  }
+  else
+  {
+    text.line_end = text.position = text.end;
+    text.good = false;
+  }
+  return true;
+}
+
+bool HmmSet::FindHtkModelHeader(HtkText &text)
+{
+  while( text.good )
+  {
+    if(IsHtkModelHeader(text.line, text.line_end))
+      return true;
+    NextHtkLine(text);
+  }
+  return false;
+}
+
+unsigned int HmmSet::LoadSingleHtkState(HtkText &text, std::string name)
+{
+  MixtureOfDiagonalGaussians mog;
+  // Reference to previously loaded state.
+  if(HtkLineStartsWith(text.line, text.line_end, "~s \"") &&
+      text.line_end - text.line > 4)
+  {
+    name = HtkMacroName(text.line, text.line_end);
+    NextHtkLine(text);
+    return mixture_index_[name];
+  }
+  // Check if it is a mixture of single Gaussian
+  if(HtkLineStartsWith(text.line, text.line_end, "<NUMMIXES>"))
+  {
+    unsigned int num_mixes = HtkNumber<unsigned int>(text.line, 
+        text.line_end, 1);
+    NextHtkLine(text);
+    for(unsigned int i = 0; i < num_mixes; ++i)
+    {
+      double mixture_weight = HtkNumber<float>(text.line, text.line_end, 2);
+      NextHtkLine(text);
+      mog.AddGaussian(LoadSingleHtkGaussian(text), mixture_weight);
+    }
+  }
+  else
+  {
+    mog.AddGaussian(LoadSingleHtkGaussian(text), 1.0);
+  }
+  unsigned int next_index = states_.size();
+  states_.push_back(std::move(mog));
+  mixture_index_[name] = next_index;
+  return next_index;
+}
+
+bool HmmSet::LoadSingleHtkHmm(HtkText &text)
+{
+  // Assume we begin by looking at the ~h line
+  std::string name = HtkMacroName(text.line, text.line_end);
+  HiddenMarkovModel hmm;
+  hmm.SetName(name);
+  NextHtkLine(text); // BEGINHMM
+  NextHtkLine(text); // NUMSTATES
+  unsigned int state_count = HtkNumber<unsigned int>(text.line, 
+      text.line_end, 1) - 2;
+  NextHtkLine(text); // STATE
+  for(unsigned int i = 0; i < state_count; ++i)
+  {
+    if(!HtkLineContains(text.line, text.line_end, "<STATE>"))
+      return false;
+    std::string state_name = name + std::string("_") + utilities::ToString(i);
+    NextHtkLine(text);
+    hmm.AddState( LoadSingleHtkState(text, state_name));
+  }
+  while(!HtkLineStartsWith(text.line, text.line_end, "<TRANSP>"))
+    if(!NextHtkLine(text))
+      return false;
+  // Load Transition Matrix
+  utilities::Matrix<double> transition;
+  transition.Initialize(state_count + 2, state_count + 2, 0);
+  for(unsigned int r = 0; r < state_count+2; ++r)
+  {
+    NextHtkLine(text);
+    const char *line = text.line, *line_end = text.line_end;
+    const char *token, *token_end;
+    TrimHtkLine(line, line_end);
+    for(unsigned int c = 0; c < state_count + 2 && 
+        NextHtkToken(line, line_end, token, token_end); ++c)
+      transition(r,c) = ParseHtkNumber<double>(token, token_end);
+  }
+  hmm.SetTransitions(transition);
+  // Find the End Token
+  while(!HtkLineStartsWith(text.line, text.line_end, "<ENDHMM>"))
+    if(!NextHtkLine(text))
+      return false;
+
+  unsigned int next_index = hmms_.size();
+  hmms_.push_back(hmm);
+  hmm_index_[hmm.name()] = next_index;
+  return true;
+}
+
+// The size given on the <MEAN> line is only used to reserve space; the values
+// themselves are counted as in LoadSingleHtkGaussian above.
+DiagonalGaussian HmmSet::LoadSingleHtkGaussian(HtkText &text)
+{
+  DiagonalGaussian g;
+  std::vector<double> mean, variance;
+  unsigned int dimension = std::min(HtkNumber<unsigned int>(text.line,
+      text.line_end, 1), 65536u);
+  mean.reserve(dimension);
+  variance.reserve(dimension);
+  // Assuming first line is mean
+  NextHtkLine(text);
+  HtkValues(text.line, text.line_end, mean);
+  NextHtkLine(text);
+  NextHtkLine(text);
+  HtkValues(text.line, text.line_end, variance);
+  g.Initialize(std::move(mean), std::move(variance));
+  NextHtkLine(text); // Skip GCONST line
+  NextHtkLine(text);
+  return g;
+}
+
 std::vector<std::vector<std::string> > HmmSet::mixture_names()
 {
   std::vector<std::vector<std::string> > ret;
-  ret.resize(states_.size());
+  ret.resize(compiled_weight_ != 0 ? packed_states_.num_mixtures() : 
+      states_.size());
   for(std::map<std::string, unsigned int>::iterator it = mixture_index_.begin();
       it != mixture_index_.end(); ++it)
     ret[it->second].push_back(it->first);
@@ -179,4 +482,334 @@ std::vector<std::vector<std::string> > HmmSet::mixture_names()
   return ret;
 }
 
+// The first name of each state is used as its macro name.
+bool HmmSet::WriteHtkHmmSet(std::string filename)
+{
+  UnpackStates();
+  std::ofstream fout(filename.c_str(), std::ios::out);
+  if( !fout.is_open() )
+    return false;
+  fout.precision(7);
+  fout<<std::scientific;
+  unsigned int dimension = packed_states_.dimension();
+  if(header_.empty())
+    fout<<"~o\n<STREAMINFO> 1 "<<dimension<<"\n<VECSIZE> "<<dimension<<
+        "<NULLD><USER><DIAGC>\n";
+  for(unsigned int i = 0; i < header_.size(); ++i)
+    fout<<header_[i]<<"\n";
+
+  std::vector<std::vector<std::string> > names = mixture_names();
+  for(unsigned int s = 0; s < states_.size(); ++s)
+  {
+    fout<<"~s \""<<names[s][0]<<"\"\n";
+    fout<<"<NUMMIXES> "<<states_[s].components()<<"\n";
+    for(unsigned int m = 0; m < states_[s].components(); ++m)
+    {
+      const DiagonalGaussian &g = states_[s].gaussian(m);
+      fout<<"<MIXTURE> "<<(m+1)<<" "<<states_[s].weight(m)<<"\n";
+      fout<<"<MEAN> "<<g.dimension()<<"\n";
+      for(unsigned int d = 0; d < g.dimension(); ++d)
+        fout<<" "<<g.mean(d);
+      fout<<"\n<VARIANCE> "<<g.dimension()<<"\n";
+      for(unsigned int d = 0; d < g.dimension(); ++d)
+        fout<<" "<<g.variance(d);
+      fout<<"\n<GCONST> "<<(-2 * g.log_constant())<<"\n";
+    }
+  }
+
+  for(unsigned int h = 0; h < hmms_.size(); ++h)
+  {
+    unsigned int states = hmms_[h].NumberOfStates();
+    fout<<"~h \""<<hmms_[h].name()<<"\"\n<BEGINHMM>\n";
+    fout<<"<NUMSTATES> "<<(states + 2)<<"\n";
+    for(unsigned int i = 0; i < states; ++i)
+    {
+      fout<<"<STATE> "<<(i + 2)<<"\n";
+      fout<<"~s \""<<names[ hmms_[h].state(i) ][0]<<"\"\n";
+    }
+    fout<<"<TRANSP> "<<(states + 2)<<"\n";
+    for(unsigned int r = 0; r < states + 2; ++r)
+    {
+      for(unsigned int c = 0; c < states + 2; ++c)
+        fout<<" "<<hmms_[h].transition(r, c);
+      fout<<"\n";
+    }
+    fout<<"<ENDHMM>\n";
+  }
+  fout.close();
+  return !fout.fail();
+}
+
+unsigned int HmmSet::MergeSimilarGaussians(double threshold)
+{
+  UnpackStates();
+  unsigned int merges = 0;
+  for(unsigned int s = 0; s < states_.size(); ++s)
+    merges += states_[s].MergeSimilarComponents(threshold);
+  packed_states_.Initialize(states_);
+  return merges;
+}
+
+// A compiled file starts with a CompiledHeader and continues with arrays
+// written by WriteAlignedArray, each starting on a 64 byte boundary:
+//   the packed states (PackedMixtureSet::WriteBinary)
+//   the linear weight of every component
+//   the variances of every component, dimension values each
+//   a CompiledName for every state name, sorted by name
+//   a CompiledHmm for every HMM
+//   the state indices of every HMM, one after another
+//   the transition matrices of every HMM, row by row
+//   a CompiledText for every header line
+//   the characters of every name and header line
+typedef struct
+{
+  char magic[4];        // "HMMB"
+  uint32_t version;
+  uint32_t byte_order;  // 0x01020304 on the machine that wrote the file.
+  uint32_t names;
+  uint32_t hmms;
+  uint32_t hmm_states;  // Sum of the states of every HMM.
+  uint32_t transitions; // Sum of the transition matrix sizes.
+  uint32_t header_lines;
+  uint32_t text_size;
+} CompiledHeader;
+
+typedef struct
+{
+  uint32_t offset;  // Into the characters at the end of the file.
+  uint32_t length;
+} CompiledText;
+
+typedef struct
+{
+  CompiledText name;
+  uint32_t state;
+} CompiledName;
+
+typedef struct
+{
+  CompiledText name;
+  uint32_t states;
+} CompiledHmm;
+
+static const uint32_t compiled_version = 1;
+static const uint32_t compiled_byte_order = 0x01020304;
+
+static CompiledText AddCompiledText(const std::string &value,
+    std::string &text)
+{
+  CompiledText ret;
+  ret.offset = text.size();
+  ret.length = value.size();
+  text += value;
+  return ret;
+}
+
+bool HmmSet::WriteCompiledHmmSet(std::string filename)
+{
+  UnpackStates();
+  if(packed_states_.num_mixtures() != states_.size())
+    return false;
+  std::ofstream fout(filename.c_str(), std::ios::out|std::ios::binary);
+  if( !fout.is_open() )
+    return false;
+
+  std::string text;
+  std::vector<CompiledName> names;
+  for(std::map<std::string, unsigned int>::iterator it = mixture_index_.begin();
+      it != mixture_index_.end(); ++it)
+  {
+    CompiledName name;
+    name.name = AddCompiledText(it->first, text);
+    name.state = it->second;
+    names.push_back(name);
+  }
+  std::vector<CompiledHmm> hmms(hmms_.size());
+  std::vector<uint32_t> hmm_states;
+  std::vector<double> transitions;
+  for(unsigned int h = 0; h < hmms_.size(); ++h)
+  {
+    unsigned int states = hmms_[h].NumberOfStates();
+    hmms[h].name = AddCompiledText(hmms_[h].name(), text);
+    hmms[h].states = states;
+    for(unsigned int i = 0; i < states; ++i)
+      hmm_states.push_back(hmms_[h].state(i));
+    for(unsigned int r = 0; r < states + 2; ++r)
+      for(unsigned int c = 0; c < states + 2; ++c)
+        transitions.push_back(hmms_[h].transition(r, c));
+  }
+  std::vector<CompiledText> header_lines(header_.size());
+  for(unsigned int i = 0; i < header_.size(); ++i)
+    header_lines[i] = AddCompiledText(header_[i], text);
+
+  unsigned int dimension = packed_states_.dimension();
+  std::vector<double> weight, variance;
+  for(unsigned int s = 0; s < states_.size(); ++s)
+    for(unsigned int m = 0; m < states_[s].components(); ++m)
+    {
+      weight.push_back(states_[s].weight(m));
+      const std::vector<double> &v = states_[s].gaussian(m).variance();
+      variance.insert(variance.end(), v.begin(), v.begin() + dimension);
+    }
+
+  CompiledHeader header;
+  std::copy("HMMB", "HMMB" + 4, header.magic);
+  header.version = compiled_version;
+  header.byte_order = compiled_byte_order;
+  header.names = names.size();
+  header.hmms = hmms.size();
+  header.hmm_states = hmm_states.size();
+  header.transitions = transitions.size();
+  header.header_lines = header_lines.size();
+  header.text_size = text.size();
+  fileutilities::WriteAlignedArray(fout, &header, 1);
+  packed_states_.WriteBinary(fout);
+  fileutilities::WriteAlignedArray(fout, weight.data(), weight.size());
+  fileutilities::WriteAlignedArray(fout, variance.data(), variance.size());
+  fileutilities::WriteAlignedArray(fout, names.data(), names.size());
+  fileutilities::WriteAlignedArray(fout, hmms.data(), hmms.size());
+  fileutilities::WriteAlignedArray(fout, hmm_states.data(), hmm_states.size());
+  fileutilities::WriteAlignedArray(fout, transitions.data(), 
+      transitions.size());
+  fileutilities::WriteAlignedArray(fout, header_lines.data(), 
+      header_lines.size());
+  fileutilities::WriteAlignedArray(fout, text.data(), text.size());
+  fout.close();
+  return !fout.fail();
+}
+
+static bool ValidCompiledText(const CompiledText &value, uint32_t text_size)
+{
+  return value.offset <= text_size && value.length <= text_size - value.offset;
+}
+
+// Every index and offset is checked against the sizes in the header before
+// the set is replaced. The packed arrays are read in scoring order rather than
+// file order, so the whole file is prefetched instead of read ahead.
+bool HmmSet::LoadCompiledHmmSet(std::string filename)
+{
+  std::shared_ptr<fileutilities::MappedFile> file = 
+      std::make_shared<fileutilities::MappedFile>();
+  if(!file->Open(filename, fileutilities::PREFETCH_ACCESS))
+    return false;
+  size_t offset = 0;
+  const CompiledHeader *header = file->Array<CompiledHeader>(offset, 1);
+  if(header == 0 || std::strncmp(header->magic, "HMMB", 4) != 0 || 
+      header->version != compiled_version ||
+      header->byte_order != compiled_byte_order)
+    return false;
+  PackedMixtureSet packed;
+  if(!packed.MapBinary(file, offset))
+    return false;
+  unsigned int components = packed.num_components();
+  const double *weight = file->Array<double>(offset, components);
+  const double *variance = file->Array<double>(offset, 
+      static_cast<size_t>(components) * packed.dimension());
+  const CompiledName *names = file->Array<CompiledName>(offset, 
+      header->names);
+  const CompiledHmm *hmms = file->Array<CompiledHmm>(offset, header->hmms);
+  const uint32_t *hmm_states = file->Array<uint32_t>(offset, 
+      header->hmm_states);
+  const double *transitions = file->Array<double>(offset, 
+      header->transitions);
+  const CompiledText *header_lines = file->Array<CompiledText>(offset,
+      header->header_lines);
+  const char *text = file->Array<char>(offset, header->text_size);
+  if(weight == 0 || variance == 0 || names == 0 || hmms == 0 || 
+      hmm_states == 0 || transitions == 0 || header_lines == 0 || text == 0)
+    return false;
+
+  std::map<std::string, unsigned int> mixture_index;
+  for(unsigned int i = 0; i < header->names; ++i)
+  {
+    if(!ValidCompiledText(names[i].name, header->text_size) ||
+        names[i].state >= packed.num_mixtures())
+      return false;
+    mixture_index[ std::string(text + names[i].name.offset, 
+        names[i].name.length) ] = names[i].state;
+  }
+  std::vector<HiddenMarkovModel> hmm_set(header->hmms);
+  std::map<std::string, unsigned int> hmm_index;
+  size_t state_offset = 0, transition_offset = 0;
+  for(unsigned int h = 0; h < header->hmms; ++h)
+  {
+    size_t states = hmms[h].states;
+    size_t size = (states + 2) * (states + 2);
+    if(!ValidCompiledText(hmms[h].name, header->text_size) ||
+        states > header->hmm_states - state_offset ||
+        size > header->transitions - transition_offset)
+      return false;
+    hmm_set[h].SetName(std::string(text + hmms[h].name.offset, 
+        hmms[h].name.length));
+    std::vector<unsigned int> state(hmm_states + state_offset, 
+        hmm_states + state_offset + states);
+    for(unsigned int i = 0; i < states; ++i)
+      if(state[i] >= packed.num_mixtures())
+        return false;
+    hmm_set[h].SetStates(state);
+    utilities::Matrix<double> transition;
+    transition.Initialize(states + 2, states + 2);
+    std::copy(transitions + transition_offset, transitions + 
+        transition_offset + size, transition.data());
+    hmm_set[h].SetTransitions(transition);
+    hmm_index[ hmm_set[h].name() ] = h;
+    state_offset += states;
+    transition_offset += size;
+  }
+  std::vector<std::string> lines(header->header_lines);
+  for(unsigned int i = 0; i < header->header_lines; ++i)
+  {
+    if(!ValidCompiledText(header_lines[i], header->text_size))
+      return false;
+    lines[i] = std::string(text + header_lines[i].offset, 
+        header_lines[i].length);
+  }
+
+  mixture_index_.swap(mixture_index);
+  hmm_index_.swap(hmm_index);
+  hmms_.swap(hmm_set);
+  header_.swap(lines);
+  states_.clear();
+  packed_states_ = packed;
+  compiled_ = file;
+  compiled_weight_ = weight;
+  compiled_variance_ = variance;
+  return true;
+}
+
+bool HmmSet::LoadHmmSet(std::string filename)
+{
+  std::ifstream fin(filename.c_str(), std::ios::in|std::ios::binary);
+  char magic[4] = {0, 0, 0, 0};
+  fin.read(magic, 4);
+  fin.close();
+  if(std::strncmp(magic, "HMMB", 4) == 0)
+    return LoadCompiledHmmSet(filename);
+  return LoadMappedHtkHmmSet(filename);
+}
+
+// The means are read back from the packed states, which hold them unchanged.
+void HmmSet::UnpackStates()
+{
+  if(compiled_weight_ == 0)
+    return;
+  unsigned int dimension = packed_states_.dimension();
+  states_.assign(packed_states_.num_mixtures(), MixtureOfDiagonalGaussians());
+  for(unsigned int s = 0; s < states_.size(); ++s)
+    for(unsigned int c = packed_states_.mixture_begin(s); 
+        c < packed_states_.mixture_end(s); ++c)
+    {
+      const double *mean = packed_states_.mean(c);
+      const double *variance = compiled_variance_ + 
+          static_cast<size_t>(c) * dimension;
+      DiagonalGaussian g;
+      g.Initialize(std::vector<double>(mean, mean + dimension),
+          std::vector<double>(variance, variance + dimension));
+      states_[s].AddGaussian(std::move(g), compiled_weight_[c]);
+    }
+  compiled_weight_ = 0;
+  compiled_variance_ = 0;
+  compiled_.reset();
+}
+
 } // end namespace statistics
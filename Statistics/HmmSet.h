@@ -10,17 +10,22 @@
 #include<string>
 #include<fstream>
 #include<iostream>
+#include<memory>
 
 #include "DiagonalGaussian.h"
 #include "MixtureOfDiagonalGaussians.h"
 #include "HiddenMarkovModel.h"
+#include "PackedMixtureSet.h"
+#include "MappedFile.h"
 #include "StringFunctions.h"
 
 namespace statistics
 {
 
 // Stores a set of HMMs. Intended for use with a set of HMMs trained using the
-// hidden markov model toolkit (HTK).
+// hidden markov model toolkit (HTK). A set can also be compiled into a binary
+// file that later loads without parsing, with the Gaussian parameters used in
+// place from a read only memory mapping.
 class HmmSet
 {
  private:
@@ -33,18 +38,59 @@ class HmmSet
   // we store them all together.
   std::vector<MixtureOfDiagonalGaussians> states_;
 
+  // The same states packed into one aligned block for fast scoring. Rebuilt
+  // whenever a file is loaded.
+  PackedMixtureSet packed_states_;
+
   // The HMM maintains information about which state uses which MOG.
   std::vector<HiddenMarkovModel> hmms_;
 
+  // Lines before the first model definition, normally the global options
+  // (~o). Kept so the set can be written back out.
+  std::vector<std::string> header_;
+
+  // Set by LoadCompiledHmmSet until states_ is rebuilt by UnpackStates. The
+  // linear weight and the variances of each component of packed_states_,
+  // which cannot be recovered exactly from the log weight and the inverse
+  // variance.
+  std::shared_ptr<const fileutilities::MappedFile> compiled_;
+  const double *compiled_weight_;
+  const double *compiled_variance_;
+
+  // Fills states_ from a compiled file if it has not been done yet.
+  void UnpackStates();
+
   // Set of functions used for reading in a set of HMMs from an HTK file.
+  static bool IsHtkModelHeader(const std::string &line);
+  static bool IsHtkModelHeader(const char *line, const char *line_end);
   bool FindHtkModelHeader(std::ifstream &fin, std::string &line);
   unsigned int LoadSingleHtkState(std::ifstream &fin, std::string &line, 
       std::string name);
   bool LoadSingleHtkHmm(std::ifstream &fin, std::string &line);
   DiagonalGaussian LoadSingleHtkGaussian(std::ifstream &fin, std::string &line);
 
+  // Position within a memory mapped HTK file. [line, line_end) is the current
+  // line without its newline. good becomes false once a line reaches the end
+  // of the file, as it would for a std::ifstream read with getline.
+  typedef struct
+  {
+    const char *position;
+    const char *end;
+    const char *line;
+    const char *line_end;
+    bool good;
+  } HtkText;
+
+  // The same functions for a memory mapped file. They follow the ones above
+  // line for line, so both loaders build the same set.
+  static bool NextHtkLine(HtkText &text);
+  bool FindHtkModelHeader(HtkText &text);
+  unsigned int LoadSingleHtkState(HtkText &text, std::string name);
+  bool LoadSingleHtkHmm(HtkText &text);
+  DiagonalGaussian LoadSingleHtkGaussian(HtkText &text);
+
  public:
-  HmmSet(){}
+  HmmSet() : compiled_weight_(0), compiled_variance_(0) {}
   ~HmmSet(){}
 
   // Loads the HMMs from a given HTK file. Assumes the HMMs uses mixures of
@@ -52,9 +98,51 @@ class HmmSet
   // possible with HTK, but are not supported by this function.
   void LoadHtkHmmSet(std::string filename);
 
+  // Same as LoadHtkHmmSet, and produces the same set, but the file is memory
+  // mapped and parsed in place. No string is built for a line or a token, so a
+  // large set loads many times faster. Returns false if the file cannot be
+  // mapped.
+  bool LoadMappedHtkHmmSet(std::string filename);
+
+  // Writes the set in the HTK format read by LoadHtkHmmSet. Every state is
+  // written once as a ~s macro and referenced by name from the HMMs that use
+  // it. Returns false if the file cannot be written.
+  bool WriteHtkHmmSet(std::string filename);
+
+  // Writes the set in a versioned binary format for LoadCompiledHmmSet: the
+  // packed parameters with their precomputed constants, the weights and
+  // variances, and the state and HMM name tables. The file is only readable
+  // on machines with the same byte order. Returns false if the file cannot be
+  // written.
+  bool WriteCompiledHmmSet(std::string filename);
+
+  // Replaces the set with one written by WriteCompiledHmmSet. The file is
+  // mapped read only and the packed parameters are used in place, so loading
+  // time does not grow with the number of Gaussians, and processes loading the
+  // same file share its pages. Only the names, HMMs and header lines are
+  // copied. The mixtures returned by states() are rebuilt from the file the
+  // first time they are needed. Returns false, and leaves the set unchanged,
+  // if the file cannot be mapped, has another version or byte order, or is
+  // truncated.
+  bool LoadCompiledHmmSet(std::string filename);
+
+  // Calls LoadCompiledHmmSet for a compiled file and LoadMappedHtkHmmSet for
+  // anything else.
+  bool LoadHmmSet(std::string filename);
+
+  // Calls MixtureOfDiagonalGaussians::MergeSimilarComponents on every state
+  // and rebuilds the packed states. Returns the total number of merges.
+  unsigned int MergeSimilarGaussians(double threshold);
+
+  // Total number of Gaussian components over every state.
+  unsigned int NumberOfGaussians() const { 
+      return packed_states_.num_components(); }
+
   // Standard accessor functions.
   std::vector<HiddenMarkovModel> hmms() { return hmms_; }
-  std::vector<MixtureOfDiagonalGaussians> states(){return states_;}
+  std::vector<MixtureOfDiagonalGaussians> states(){
+      UnpackStates(); return states_;}
+  const PackedMixtureSet& packed_states() const { return packed_states_; }
   std::vector<std::vector<std::string> > mixture_names();
   HiddenMarkovModel Hmm(std::string name) const {     // Find() is used because 
       return hmms_[ hmm_index_.find(name)->second ];} // it is const.
@@ -8,13 +8,33 @@ namespace statistics
 {
 
 void MixtureOfDiagonalGaussians::SetAllGaussians(
-    std::vector<DiagonalGaussian> gaussian,std::vector<double> weight)
+    const std::vector<DiagonalGaussian> &gaussian,
+    const std::vector<double> &weight)
 {
   gaussian_ = gaussian;
   weight_ = weight;
+  log_weight_.resize(weight_.size());
+  for(unsigned int i = 0; i < weight_.size(); ++i)
+    log_weight_[i] = std::log(weight_[i]);
+}
+
+void MixtureOfDiagonalGaussians::SetAllGaussians(
+    std::vector<DiagonalGaussian> &&gaussian, std::vector<double> &&weight)
+{
+  gaussian_ = std::move(gaussian);
+  weight_ = std::move(weight);
+  log_weight_.resize(weight_.size());
+  for(unsigned int i = 0; i < weight_.size(); ++i)
+    log_weight_[i] = std::log(weight_[i]);
 }
 
-double MixtureOfDiagonalGaussians::Likelihood(std::vector<double> &point) const
+double MixtureOfDiagonalGaussians::Likelihood(
+    const std::vector<double> &point) const
+{
+  return Likelihood(&point[0]);
+}
+
+double MixtureOfDiagonalGaussians::Likelihood(const double *point) const
 {
   double ret = 0;
   for(unsigned int i = 0; i < gaussian_.size(); ++i)
@@ -23,9 +43,34 @@ double MixtureOfDiagonalGaussians::Likelihood(std::vector<double> &point) const
 }
 
 double MixtureOfDiagonalGaussians::LogLikelihood(
-    std::vector<double> &point) const
+    const std::vector<double> &point) const
+{
+  return LogLikelihood(&point[0]);
+}
+
+// The components are combined with a running log-sum-exp. Whenever a new
+// maximum is found, the sum is rescaled to it so only one pass is needed. A
+// component with a score of -inf, such as one with a weight of zero, adds
+// nothing and is skipped, since it would otherwise give exp(-inf - -inf).
+double MixtureOfDiagonalGaussians::LogLikelihood(const double *point) const
 {
-  return log(Likelihood(point));
+  double negative_infinity = -std::numeric_limits<double>::infinity();
+  double max_value = negative_infinity;
+  double total = 0;
+  for(unsigned int i = 0; i < gaussian_.size(); ++i)
+  {
+    double value = log_weight_[i] + gaussian_[i].LogLikelihood(point);
+    if(value == negative_infinity)
+      continue;
+    if(value > max_value)
+    {
+      total = total * std::exp(max_value - value) + 1;
+      max_value = value;
+    }
+    else
+      total += std::exp(value - max_value);
+  }
+  return max_value + std::log(total);
 }
 
 // Implementation matches the results on the testset provided in the orginal
@@ -36,7 +81,7 @@ double MixtureOfDiagonalGaussians::LogLikelihood(
 // implementation and evaluates their testset correctly, I am willing to trust
 // this implementation is the correct one.
 double MixtureOfDiagonalGaussians::CSDivergence
-    (MixtureOfDiagonalGaussians mog) const
+    (const MixtureOfDiagonalGaussians &mog) const
 {
   // Divergence measure is split into three terms.
   double first_term = 0, second_term = 0, third_term = 0;
@@ -45,19 +90,11 @@ double MixtureOfDiagonalGaussians::CSDivergence
   for(unsigned int i = 0; i < components(); ++i)
   {
     for(unsigned int j = 0; j < mog.components(); ++j)
-    {
-      DiagonalGaussian g = mog.gaussian(j);
-      g.AddVariance(gaussian_[i].variance());
       first_term += (weight_[i] * mog.weight(j) * 
-          g.Likelihood(gaussian_[i].mean()) );
-    }
+          gaussian_[i].ProductIntegral(mog.gaussian(j)) );
     for(unsigned int k = 0; k < components(); ++k)
-    {
-      DiagonalGaussian g = gaussian_[k];
-      g.AddVariance(gaussian_[i].variance());
       inner_term += (weight_[i] * weight_[k] *
-          g.Likelihood(gaussian_[i].mean()));
-    }
+          gaussian_[i].ProductIntegral(gaussian_[k]));
   }
   second_term += (1 * inner_term);
 
@@ -66,12 +103,8 @@ double MixtureOfDiagonalGaussians::CSDivergence
   for(unsigned int j = 0; j < mog.components(); ++j)
   {
     for(unsigned int k = 0; k < mog.components(); ++k)
-    {
-      DiagonalGaussian g = mog.gaussian(j);
-      g.AddVariance(mog.gaussian(k).variance());
       inner_term += (mog.weight(j) * mog.weight(k) *
-          g.Likelihood(mog.gaussian(k).mean()));
-    }
+          mog.gaussian(k).ProductIntegral(mog.gaussian(j)));
   }
   third_term += (1 * inner_term);
 
@@ -97,7 +130,83 @@ void MixtureOfDiagonalGaussians::NormalizeWeights()
   for(unsigned int i = 0; i < weight_.size(); ++i)
     total += weight_[i];
   for(unsigned int i = 0; i < weight_.size(); ++i)
+  {
     weight_[i] = weight_[i] / total;
+    log_weight_[i] = std::log(weight_[i]);
+  }
+}
+
+// The merged Gaussian matches the first two moments of the weighted pair:
+//   mu = (wa * mu_a + wb * mu_b) / w
+//   var = (wa * (var_a + (mu_a - mu)^2) + wb * (var_b + (mu_b - mu)^2)) / w
+// The variance is summed around the merged mean rather than taken as
+// E[x^2] - mu^2, which cancels badly for means far from zero. Two components
+// with a weight of zero are merged with equal weights.
+static DiagonalGaussian MergeGaussians(const DiagonalGaussian &a, double wa,
+    const DiagonalGaussian &b, double wb)
+{
+  unsigned int dimension = a.dimension();
+  if( !(wa + wb > 0) )
+  {
+    wa = 1;
+    wb = 1;
+  }
+  double w = wa + wb;
+  std::vector<double> mean(dimension), variance(dimension);
+  for(unsigned int d = 0; d < dimension; ++d)
+  {
+    mean[d] = (wa * a.mean(d) + wb * b.mean(d)) / w;
+    double da = a.mean(d) - mean[d];
+    double db = b.mean(d) - mean[d];
+    variance[d] = (wa * (a.variance(d) + da * da) +
+        wb * (b.variance(d) + db * db)) / w;
+  }
+  DiagonalGaussian ret;
+  ret.Initialize(std::move(mean), std::move(variance));
+  return ret;
+}
+
+// Greedy. The divergence table is kept between merges and only the row and
+// column of the merged component are recomputed.
+unsigned int MixtureOfDiagonalGaussians::MergeSimilarComponents(
+    double threshold)
+{
+  unsigned int merges = 0;
+  unsigned int n = gaussian_.size();
+  std::vector<std::vector<double> > divergence(n, std::vector<double>(n, 0));
+  for(unsigned int i = 0; i < n; ++i)
+    for(unsigned int j = i + 1; j < n; ++j)
+      divergence[i][j] = gaussian_[i].SymmetricKLDivergence(gaussian_[j]);
+  while(gaussian_.size() > 1)
+  {
+    n = gaussian_.size();
+    unsigned int best_i = 0, best_j = 1;
+    for(unsigned int i = 0; i < n; ++i)
+      for(unsigned int j = i + 1; j < n; ++j)
+        if(divergence[i][j] < divergence[best_i][best_j])
+        {
+          best_i = i;
+          best_j = j;
+        }
+    if( !(divergence[best_i][best_j] < threshold) )
+      break;
+    gaussian_[best_i] = MergeGaussians(gaussian_[best_i], weight_[best_i],
+        gaussian_[best_j], weight_[best_j]);
+    weight_[best_i] += weight_[best_j];
+    log_weight_[best_i] = std::log(weight_[best_i]);
+    gaussian_.erase(gaussian_.begin() + best_j);
+    weight_.erase(weight_.begin() + best_j);
+    log_weight_.erase(log_weight_.begin() + best_j);
+    divergence.erase(divergence.begin() + best_j);
+    for(unsigned int i = 0; i < divergence.size(); ++i)
+      divergence[i].erase(divergence[i].begin() + best_j);
+    for(unsigned int i = 0; i < gaussian_.size(); ++i)
+      if(i != best_i)
+        divergence[std::min(i, best_i)][std::max(i, best_i)] = 
+            gaussian_[i].SymmetricKLDivergence(gaussian_[best_i]);
+    merges++;
+  }
+  return merges;
 }
 
 // Selects one Gaussian from the mixture based on the weights and then samples
@@ -110,7 +219,7 @@ std::vector<double> MixtureOfDiagonalGaussians::Sample(
   double total_weight = 0;
   for(unsigned int i = 0; i < weight_.size(); ++i)
   {
-    total_weight += weight_.size();
+    total_weight += weight_[i];
     if(point <= total_weight)
       return gaussian_[i].Sample(generator);
   }
@@ -8,6 +8,7 @@
 #include <vector>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include "DiagonalGaussian.h"
 
 // Stores and evaluates mixtures of Gaussians where the covariance matrix is
@@ -23,6 +24,8 @@ class MixtureOfDiagonalGaussians
   std::vector<DiagonalGaussian> gaussian_;
   std::vector<double> weight_; // Weight vector should be normalized to one, but
                                // this is not enforced.
+  std::vector<double> log_weight_; // log of weight_, kept for the log domain
+                                   // evaluation.
   
  public:
   MixtureOfDiagonalGaussians(){}
@@ -30,36 +33,58 @@ class MixtureOfDiagonalGaussians
 
   // Adds an additional Gaussian to the mixture. The weight must be included,
   // but no constraints are enforced on the value.
-  void AddGaussian(DiagonalGaussian g, double w){
-      gaussian_.push_back(g); weight_.push_back(w);}
+  void AddGaussian(const DiagonalGaussian &g, double w){
+      gaussian_.push_back(g); weight_.push_back(w);
+      log_weight_.push_back(std::log(w));}
+  void AddGaussian(DiagonalGaussian &&g, double w){
+      gaussian_.push_back(std::move(g)); weight_.push_back(w);
+      log_weight_.push_back(std::log(w));}
 
   // Initializes the mixture by supplying a vector of Gaussians and the weight
-  // vector.
-  void SetAllGaussians(std::vector<DiagonalGaussian> gaussian, 
-      std::vector<double> weight);
+  // vector. The rvalue version takes ownership of the vectors.
+  void SetAllGaussians(const std::vector<DiagonalGaussian> &gaussian, 
+      const std::vector<double> &weight);
+  void SetAllGaussians(std::vector<DiagonalGaussian> &&gaussian, 
+      std::vector<double> &&weight);
 
-  // Returns the likelihood of the entire mixture.
-  double Likelihood(std::vector<double> &point) const;
-  double LogLikelihood(std::vector<double> &point) const;
+  // Returns the likelihood of the entire mixture. The pointer version reads
+  // one value per dimension.
+  double Likelihood(const std::vector<double> &point) const;
+  double Likelihood(const double *point) const;
+  double LogLikelihood(const std::vector<double> &point) const;
+
+  // Log likelihood of the mixture computed entirely in the log domain with
+  // the log weights and DiagonalGaussian::LogLikelihood. Does not underflow
+  // when every component is far from the point.
+  double LogLikelihood(const double *point) const;
 
   // Returns a value known as the Cauchy-Schwarz divergence, a symmetric
   // distance measure between two MOG distributions. It is similar to KL 
   // divergence, but it has a closed form solution and can be computed quickly.
   // More information can be found in the paper "Closed-form Cauchy-Schwarz PDF
   // divergence for mixture of Gaussians" by K. Kampa et al.
-  double CSDivergence(MixtureOfDiagonalGaussians mog) const;
+  double CSDivergence(const MixtureOfDiagonalGaussians &mog) const;
 
   // Returns number of Gaussians in the mixture.
   unsigned int components() const {return gaussian_.size();}
 
   // Standard accessor functions.
   double weight(unsigned int i) const {return weight_[i];}
-  DiagonalGaussian gaussian(unsigned int i) const {return gaussian_[i];}
+  double log_weight(unsigned int i) const {return log_weight_[i];}
+  const DiagonalGaussian& gaussian(unsigned int i) const {
+      return gaussian_[i];}
   std::vector<double> WeightedMean() const;
 
   // Renormalizes the weight vector so that the weights sum to one.
   void NormalizeWeights();
 
+  // Reduces the number of components by repeatedly merging the pair of
+  // components with the smallest symmetric KL divergence, as long as it is
+  // below threshold. A merged component has the weight, mean, and variance of
+  // the pair it replaces (moment matching), so the weights still sum to the
+  // same total. Returns the number of merges.
+  unsigned int MergeSimilarComponents(double threshold);
+
   // Sample from the GMM
   std::vector<double> Sample(std::default_random_engine &generator) const;
  
@@ -0,0 +1,233 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#include "MixtureSampler.h"
+
+namespace statistics
+{
+
+bool MixtureSampler::Initialize(
+    const std::vector<MixtureOfDiagonalGaussians> &mog)
+{
+  unsigned int components = 0;
+  mixture_offset_.resize(mog.size() + 1);
+  dimension_ = 0;
+  for(unsigned int g = 0; g < mog.size(); ++g)
+  {
+    mixture_offset_[g] = components;
+    components += mog[g].components();
+    if(dimension_ == 0 && mog[g].components() > 0)
+      dimension_ = mog[g].gaussian(0).dimension();
+  }
+  mixture_offset_[mog.size()] = components;
+
+  mean_.resize(static_cast<size_t>(components) * dimension_);
+  standard_deviation_.resize(static_cast<size_t>(components) * dimension_);
+  probability_.resize(components);
+  alias_.resize(components);
+  for(unsigned int g = 0; g < mog.size(); ++g)
+  {
+    for(unsigned int i = 0; i < mog[g].components(); ++i)
+    {
+      const DiagonalGaussian &gaussian = mog[g].gaussian(i);
+      if(gaussian.dimension() != dimension_)
+      {
+        Initialize(std::vector<MixtureOfDiagonalGaussians>());
+        return false;
+      }
+      size_t start = static_cast<size_t>(mixture_offset_[g] + i) * dimension_;
+      for(unsigned int d = 0; d < dimension_; ++d)
+      {
+        mean_[start + d] = gaussian.mean(d);
+        standard_deviation_[start + d] = std::sqrt(gaussian.variance(d));
+      }
+    }
+    BuildAliasTable(g, mog[g]);
+  }
+  return true;
+}
+
+// Vose's method. Every weight is scaled so the average is one. Slots below
+// one are paired with a slot above one, which gives up the missing
+// probability and becomes the alias.
+void MixtureSampler::BuildAliasTable(unsigned int g,
+    const MixtureOfDiagonalGaussians &mog)
+{
+  unsigned int n = mog.components();
+  unsigned int offset = mixture_offset_[g];
+  if(n == 0)
+    return;
+  double total = 0;
+  for(unsigned int i = 0; i < n; ++i)
+    total += mog.weight(i);
+  std::vector<double> scaled(n);
+  std::vector<unsigned int> small, large;
+  for(unsigned int i = 0; i < n; ++i)
+  {
+    scaled[i] = (total > 0) ? mog.weight(i) * n / total : 1;
+    if(scaled[i] < 1)
+      small.push_back(i);
+    else
+      large.push_back(i);
+  }
+  while(!small.empty() && !large.empty())
+  {
+    unsigned int s = small.back();
+    unsigned int l = large.back();
+    small.pop_back();
+    large.pop_back();
+    probability_[offset + s] = scaled[s];
+    alias_[offset + s] = l;
+    scaled[l] = (scaled[l] + scaled[s]) - 1;
+    if(scaled[l] < 1)
+      small.push_back(l);
+    else
+      large.push_back(l);
+  }
+  // Whatever is left is one up to rounding error.
+  for(unsigned int i = 0; i < large.size(); ++i)
+  {
+    probability_[offset + large[i]] = 1;
+    alias_[offset + large[i]] = large[i];
+  }
+  for(unsigned int i = 0; i < small.size(); ++i)
+  {
+    probability_[offset + small[i]] = 1;
+    alias_[offset + small[i]] = small[i];
+  }
+}
+
+// Tables for the ziggurat method of Marsaglia and Tsang, "The Ziggurat Method
+// for Generating Random Variables", 2000. The normal density is covered by 128
+// layers of equal area. A value is drawn from a random layer and accepted at
+// once unless it falls outside the density, which happens about 1% of the
+// time. The integers are scaled by 2^30 because std::default_random_engine
+// gives 31 random bits. The assertion catches a library whose default engine
+// has another range, for which the tables and the sign split would be wrong.
+// The Lehmer engines lack a few values at the ends of the range, which only
+// moves the extreme edge of a layer by a few parts in 2^30.
+static_assert(std::default_random_engine::max() -
+    std::default_random_engine::min() <= 2147483647UL &&
+    std::default_random_engine::max() -
+    std::default_random_engine::min() >= 2147483640UL,
+    "The ziggurat tables need an engine with 31 random bits.");
+
+typedef struct
+{
+  double k[128]; // Acceptance limits for the integer part.
+  double w[128]; // Scale from integer to value for each layer.
+  double f[128]; // Density at the edge of each layer.
+} ZigguratTables;
+
+static ZigguratTables BuildZiggurat()
+{
+  ZigguratTables table;
+  double scale = 1073741824.0; // 2^30
+  double d = 3.442619855899, t = d, v = 9.91256303526217e-3;
+  double q = v / std::exp(-0.5 * d * d);
+  table.k[0] = (d / q) * scale;
+  table.k[1] = 0;
+  table.w[0] = q / scale;
+  table.w[127] = d / scale;
+  table.f[0] = 1;
+  table.f[127] = std::exp(-0.5 * d * d);
+  for(int i = 126; i >= 1; --i)
+  {
+    d = std::sqrt(-2 * std::log(v / d + std::exp(-0.5 * d * d)));
+    table.k[i+1] = (d / t) * scale;
+    t = d;
+    table.f[i] = std::exp(-0.5 * d * d);
+    table.w[i] = d / scale;
+  }
+  return table;
+}
+
+// A uniform value in (0, 1) from a single draw.
+static double OpenUniform(std::default_random_engine &generator)
+{
+  return (generator() - generator.min() + 0.5) / 
+      (static_cast<double>(generator.max() - generator.min()) + 1);
+}
+
+unsigned int MixtureSampler::SampleComponent(unsigned int g,
+    std::default_random_engine &generator) const
+{
+  unsigned int offset = mixture_offset_[g];
+  unsigned int n = mixture_offset_[g+1] - offset;
+  double x = OpenUniform(generator) * n;
+  unsigned int i = std::min(static_cast<unsigned int>(x), n - 1);
+  if(x - i < probability_[offset + i])
+    return i;
+  return alias_[offset + i];
+}
+
+// Each draw of the engine is used both for the layer, from its low seven bits,
+// and for the signed value, as in the original method.
+void MixtureSampler::StandardNormals(unsigned int count,
+    std::default_random_engine &generator, double *out)
+{
+  static const ZigguratTables table = BuildZiggurat();
+  const double tail = 3.442619855899;
+  for(unsigned int i = 0; i < count; ++i)
+  {
+    double x;
+    for(;;)
+    {
+      unsigned long j = generator() - generator.min();
+      unsigned int layer = j & 127;
+      long value = static_cast<long>(j) - 1073741824L;
+      x = value * table.w[layer];
+      if(std::labs(value) < table.k[layer])
+        break;
+      if(layer == 0)
+      {
+        // The base layer includes the tail beyond the last edge.
+        double y;
+        do
+        {
+          x = -std::log(OpenUniform(generator)) / tail;
+          y = -std::log(OpenUniform(generator));
+        } while(y + y < x * x);
+        x = (value > 0) ? tail + x : -tail - x;
+        break;
+      }
+      if(table.f[layer] + OpenUniform(generator) * 
+          (table.f[layer-1] - table.f[layer]) < std::exp(-0.5 * x * x))
+        break;
+    }
+    out[i] = x;
+  }
+}
+
+void MixtureSampler::Sample(const std::vector<unsigned int> &mixtures,
+    std::default_random_engine &generator,
+    utilities::Matrix<double> &data) const
+{
+  unsigned int frames = mixtures.size();
+  data.Initialize(dimension_, frames);
+  if(frames == 0 || dimension_ == 0)
+    return;
+  std::vector<unsigned int> component(frames);
+  for(unsigned int f = 0; f < frames; ++f)
+    component[f] = mixture_offset_[ mixtures[f] ] +
+        SampleComponent(mixtures[f], generator);
+  std::vector<double> normal(static_cast<size_t>(frames) * dimension_);
+  StandardNormals(normal.size(), generator, &normal[0]);
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    size_t start = static_cast<size_t>(component[f]) * dimension_;
+    const double *z = &normal[static_cast<size_t>(f) * dimension_];
+    for(unsigned int d = 0; d < dimension_; ++d)
+      data(d, f) = mean_[start + d] + standard_deviation_[start + d] * z[d];
+  }
+}
+
+void MixtureSampler::Sample(unsigned int g, unsigned int count,
+    std::default_random_engine &generator,
+    utilities::Matrix<double> &data) const
+{
+  Sample(std::vector<unsigned int>(count, g), generator, data);
+}
+
+} // end namespace statistics
@@ -0,0 +1,83 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef STATISTICS_MIXTURESAMPLER_H_
+#define STATISTICS_MIXTURESAMPLER_H_
+
+#include<vector>
+#include<random>
+#include<cmath>
+#include<algorithm>
+#include<cstdlib>
+#include "MixtureOfDiagonalGaussians.h"
+#include "Matrix.h"
+
+// Draws many samples from a set of mixtures of diagonal Gaussians at once.
+// MixtureOfDiagonalGaussians::Sample picks a component with a linear scan and
+// builds a new normal distribution for every dimension of every frame. Here
+// each mixture has an alias table, so picking a component takes one uniform
+// draw and one comparison whatever the number of components. The normal
+// values for a whole batch of frames are generated together with the ziggurat
+// method, then scaled by the standard deviation and shifted by the mean of the
+// chosen component.
+
+namespace statistics
+{
+
+class MixtureSampler
+{
+ private:
+  unsigned int dimension_;
+  // The components of mixture g are [mixture_offset_[g], mixture_offset_[g+1]).
+  std::vector<unsigned int> mixture_offset_;
+  // Component c starts at c * dimension_.
+  std::vector<double> mean_;
+  std::vector<double> standard_deviation_;
+  // Alias table. Slot i of a mixture keeps its own component with probability
+  // probability_[i] and otherwise gives alias_[i]. Both are indexed by the
+  // global component number.
+  std::vector<double> probability_;
+  std::vector<unsigned int> alias_;
+
+  // Fills the alias table entries of mixture g from its weights.
+  void BuildAliasTable(unsigned int g, const MixtureOfDiagonalGaussians &mog);
+
+ public:
+  MixtureSampler() : dimension_(0) {}
+  ~MixtureSampler() {}
+
+  // Copies the parameters of every mixture and builds the alias tables. The
+  // weights do not need to sum to one. Returns false if the Gaussians do not
+  // all have the same dimension.
+  bool Initialize(const std::vector<MixtureOfDiagonalGaussians> &mog);
+
+  unsigned int dimension() const { return dimension_; }
+  unsigned int num_mixtures() const { return mixture_offset_.empty() ?
+      0 : mixture_offset_.size() - 1; }
+
+  // Chooses a component of mixture g according to the weights. The result is
+  // an index within the mixture.
+  unsigned int SampleComponent(unsigned int g,
+      std::default_random_engine &generator) const;
+
+  // Fills out with count independent standard normal values. Usually takes a
+  // single draw from generator per value.
+  static void StandardNormals(unsigned int count,
+      std::default_random_engine &generator, double *out);
+
+  // Fills data, resized to (feature x frame), with one frame drawn from
+  // mixture mixtures[f] for every frame f.
+  void Sample(const std::vector<unsigned int> &mixtures,
+      std::default_random_engine &generator,
+      utilities::Matrix<double> &data) const;
+
+  // Fills data, resized to (feature x frame), with count frames drawn from
+  // mixture g.
+  void Sample(unsigned int g, unsigned int count,
+      std::default_random_engine &generator,
+      utilities::Matrix<double> &data) const;
+};
+
+} // end namespace statistics
+#endif
@@ -0,0 +1,401 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#include "PackedMixtureSet.h"
+
+namespace statistics
+{
+
+// Storage for a set built from MixtureOfDiagonalGaussians.
+typedef struct
+{
+  std::vector<uint32_t> mixture_offset;
+  std::vector<uint32_t> component_mixture;
+  utilities::AlignedArray<double> parameters;
+  std::vector<double> log_weight;
+  std::vector<double> log_constant;
+} PackedStorage;
+
+bool PackedMixtureSet::Initialize(
+    const std::vector<MixtureOfDiagonalGaussians> &mog)
+{
+  std::shared_ptr<PackedStorage> storage = std::make_shared<PackedStorage>();
+  unsigned int components = 0;
+  storage->mixture_offset.resize(mog.size() + 1);
+  for(unsigned int g = 0; g < mog.size(); ++g)
+  {
+    storage->mixture_offset[g] = components;
+    components += mog[g].components();
+  }
+  storage->mixture_offset[mog.size()] = components;
+  unsigned int dimension = 0;
+  for(unsigned int g = 0; g < mog.size() && dimension == 0; ++g)
+    if(mog[g].components() > 0)
+      dimension = mog[g].gaussian(0).dimension();
+  unsigned int padded_dimension = ((dimension + 7) / 8) * 8;
+
+  storage->parameters.Initialize(static_cast<size_t>(components) * 2 *
+      padded_dimension, 0);
+  storage->log_weight.resize(components);
+  storage->log_constant.resize(components);
+  storage->component_mixture.resize(components);
+  for(unsigned int g = 0; g < mog.size(); ++g)
+    for(unsigned int i = 0; i < mog[g].components(); ++i)
+    {
+      unsigned int c = storage->mixture_offset[g] + i;
+      const DiagonalGaussian &gaussian = mog[g].gaussian(i);
+      if(gaussian.dimension() != dimension)
+      {
+        Initialize(std::vector<MixtureOfDiagonalGaussians>());
+        return false;
+      }
+      double *component = storage->parameters.data() +
+          static_cast<size_t>(c) * 2 * padded_dimension;
+      for(unsigned int d = 0; d < dimension; ++d)
+      {
+        component[d] = gaussian.mean(d);
+        component[padded_dimension + d] = 1 / gaussian.variance(d);
+      }
+      storage->log_weight[c] = mog[g].log_weight(i);
+      storage->log_constant[c] = gaussian.log_constant();
+      storage->component_mixture[c] = g;
+    }
+
+  dimension_ = dimension;
+  padded_dimension_ = padded_dimension;
+  mixtures_ = mog.size();
+  components_ = components;
+  mixture_offset_ = storage->mixture_offset.data();
+  component_mixture_ = storage->component_mixture.data();
+  parameters_ = storage->parameters.data();
+  log_weight_ = storage->log_weight.data();
+  log_constant_ = storage->log_constant.data();
+  storage_ = storage;
+  SelectKernel();
+  return true;
+}
+
+// A small header of sizes is followed by each array.
+void PackedMixtureSet::WriteBinary(std::ostream &out) const
+{
+  uint32_t sizes[4] = {dimension_, padded_dimension_, mixtures_, components_};
+  fileutilities::WriteAlignedArray(out, sizes, 4);
+  fileutilities::WriteAlignedArray(out, mixture_offset_, mixtures_ + 1);
+  fileutilities::WriteAlignedArray(out, component_mixture_, components_);
+  fileutilities::WriteAlignedArray(out, parameters_, 
+      static_cast<size_t>(components_) * 2 * padded_dimension_);
+  fileutilities::WriteAlignedArray(out, log_weight_, components_);
+  fileutilities::WriteAlignedArray(out, log_constant_, components_);
+}
+
+// The mixture offsets and component owners are checked, since every accessor
+// trusts them. The parameters themselves are used as they are.
+bool PackedMixtureSet::MapBinary(
+    const std::shared_ptr<const fileutilities::MappedFile> &file, 
+    size_t &offset)
+{
+  Initialize(std::vector<MixtureOfDiagonalGaussians>());
+  const uint32_t *sizes = file->Array<uint32_t>(offset, 4);
+  if(sizes == 0 || sizes[1] != ((sizes[0] + 7) / 8) * 8)
+    return false;
+  unsigned int mixtures = sizes[2];
+  unsigned int components = sizes[3];
+  const uint32_t *mixture_offset = file->Array<uint32_t>(offset, 
+      static_cast<size_t>(mixtures) + 1);
+  const uint32_t *component_mixture = file->Array<uint32_t>(offset, 
+      components);
+  const double *parameters = file->Array<double>(offset, 
+      static_cast<size_t>(components) * 2 * sizes[1]);
+  const double *log_weight = file->Array<double>(offset, components);
+  const double *log_constant = file->Array<double>(offset, components);
+  if(mixture_offset == 0 || component_mixture == 0 || parameters == 0 ||
+      log_weight == 0 || log_constant == 0)
+    return false;
+  if(mixture_offset[0] != 0 || mixture_offset[mixtures] != components)
+    return false;
+  for(unsigned int g = 0; g < mixtures; ++g)
+  {
+    if(mixture_offset[g+1] < mixture_offset[g])
+      return false;
+    for(unsigned int c = mixture_offset[g]; c < mixture_offset[g+1]; ++c)
+      if(component_mixture[c] != g)
+        return false;
+  }
+
+  dimension_ = sizes[0];
+  padded_dimension_ = sizes[1];
+  mixtures_ = mixtures;
+  components_ = components;
+  mixture_offset_ = mixture_offset;
+  component_mixture_ = component_mixture;
+  parameters_ = parameters;
+  log_weight_ = log_weight;
+  log_constant_ = log_constant;
+  storage_ = file;
+  SelectKernel();
+  return true;
+}
+
+void PackedMixtureSet::PadPoint(const double *point, double *padded) const
+{
+  std::copy(point, point + dimension_, padded);
+  std::fill(padded + dimension_, padded + padded_dimension_, 0.0);
+}
+
+// Weighted squared distance between a padded point and a packed component. The
+// padded length is a multiple of eight, so the loop always runs over whole
+// groups and keeps four independent partial sums. D is the padded dimension
+// when it is known at compile time and 0 when it is read from
+// padded_dimension, so the fixed versions are fully unrolled by the compiler.
+template<unsigned int D>
+static double PackedDistance(const double *mean, const double *point,
+    unsigned int padded_dimension)
+{
+  if(D > 0)
+    padded_dimension = D;
+  const double *inverse_variance = mean + padded_dimension;
+  double sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+  for(unsigned int d = 0; d < padded_dimension; d += 8)
+  {
+    double diff0 = point[d] - mean[d];
+    double diff1 = point[d+1] - mean[d+1];
+    double diff2 = point[d+2] - mean[d+2];
+    double diff3 = point[d+3] - mean[d+3];
+    double diff4 = point[d+4] - mean[d+4];
+    double diff5 = point[d+5] - mean[d+5];
+    double diff6 = point[d+6] - mean[d+6];
+    double diff7 = point[d+7] - mean[d+7];
+    sum0 += diff0 * diff0 * inverse_variance[d] +
+        diff4 * diff4 * inverse_variance[d+4];
+    sum1 += diff1 * diff1 * inverse_variance[d+1] +
+        diff5 * diff5 * inverse_variance[d+5];
+    sum2 += diff2 * diff2 * inverse_variance[d+2] +
+        diff6 * diff6 * inverse_variance[d+6];
+    sum3 += diff3 * diff3 * inverse_variance[d+3] +
+        diff7 * diff7 * inverse_variance[d+7];
+  }
+  return (sum0 + sum1) + (sum2 + sum3);
+}
+
+// Distances from one component to count padded points stored one after
+// another. The component stays in the L1 cache for the whole block. Distance f
+// is written to distance[f * stride].
+template<unsigned int D>
+static void PackedBlockDistance(const double *mean, const double *points,
+    unsigned int count, unsigned int padded_dimension, double *distance,
+    size_t stride)
+{
+  if(D > 0)
+    padded_dimension = D;
+  for(unsigned int f = 0; f < count; ++f)
+    distance[f * stride] = PackedDistance<D>(mean, points + 
+        static_cast<size_t>(f) * padded_dimension, padded_dimension);
+}
+
+// Features are usually 39 dimensional PLP or MFCC vectors or 100 dimensional
+// posteriorgrams, which pad to 40 and 104.
+void PackedMixtureSet::SelectKernel()
+{
+  fixed_kernel_ = true;
+  if(padded_dimension_ == 40)
+  {
+    distance_ = PackedDistance<40>;
+    block_distance_ = PackedBlockDistance<40>;
+  }
+  else if(padded_dimension_ == 104)
+  {
+    distance_ = PackedDistance<104>;
+    block_distance_ = PackedBlockDistance<104>;
+  }
+  else
+  {
+    distance_ = PackedDistance<0>;
+    block_distance_ = PackedBlockDistance<0>;
+    fixed_kernel_ = false;
+  }
+}
+
+double PackedMixtureSet::ComponentLogLikelihood(unsigned int c,
+    const double *point) const
+{
+  return log_weight_[c] + log_constant_[c] - 0.5 * distance_(mean(c), point,
+      padded_dimension_);
+}
+
+double PackedMixtureSet::MixtureLogLikelihood(unsigned int g,
+    const double *point) const
+{
+  unsigned int begin = mixture_offset_[g];
+  unsigned int end = mixture_offset_[g+1];
+  // Running log-sum-exp so no buffer is needed. Components that score -inf,
+  // such as those with a weight of zero, are skipped as in
+  // MixtureOfDiagonalGaussians::LogLikelihood.
+  double negative_infinity = -std::numeric_limits<double>::infinity();
+  double max_value = negative_infinity;
+  double sum = 0;
+  for(unsigned int c = begin; c < end; ++c)
+  {
+    double value = ComponentLogLikelihood(c, point);
+    if(value == negative_infinity)
+      continue;
+    if(value > max_value)
+    {
+      sum = sum * std::exp(max_value - value) + 1;
+      max_value = value;
+    }
+    else
+    {
+      sum += std::exp(value - max_value);
+    }
+  }
+  return max_value + std::log(sum);
+}
+
+void PackedMixtureSet::ComponentLogLikelihoods(const double *points,
+    unsigned int count, unsigned int begin, unsigned int end,
+    double *tile) const
+{
+  unsigned int width = end - begin;
+  for(unsigned int c = begin; c < end; ++c)
+  {
+    double *column = tile + (c - begin);
+    block_distance_(mean(c), points, count, padded_dimension_, column, width);
+    double constant = log_weight_[c] + log_constant_[c];
+    for(unsigned int f = 0; f < count; ++f)
+      column[f * width] = constant - 0.5 * column[f * width];
+  }
+}
+
+void PackedMixtureSet::LogLikelihoods(const double *frames, unsigned int count,
+    utilities::Matrix<double> &log_likelihood) const
+{
+  log_likelihood.Initialize(count, num_mixtures());
+  LogLikelihoods(frames, dimension_, 1, count, log_likelihood.data());
+}
+
+// Frames are scored in blocks so each component is read once per block rather
+// than once per frame. The tile only covers one mixture at a time, so it stays
+// small enough for the L1 cache.
+void PackedMixtureSet::LogLikelihoods(const double *data, size_t frame_stride,
+    size_t feature_stride, unsigned int count, double *log_likelihood) const
+{
+  const unsigned int block = 16;
+  unsigned int mixtures = num_mixtures();
+  unsigned int largest = 0;
+  for(unsigned int g = 0; g < mixtures; ++g)
+    largest = std::max(largest, mixture_end(g) - mixture_begin(g));
+  // The padding past dimension_ stays zero.
+  utilities::AlignedArray<double> points;
+  points.Initialize(static_cast<size_t>(block) * padded_dimension_, 0);
+  std::vector<double> tile(static_cast<size_t>(block) * largest);
+  for(unsigned int start = 0; start < count; start += block)
+  {
+    unsigned int size = std::min(block, count - start);
+    for(unsigned int f = 0; f < size; ++f)
+    {
+      const double *frame = data + (start + f) * frame_stride;
+      double *point = points.data() + static_cast<size_t>(f) * 
+          padded_dimension_;
+      for(unsigned int d = 0; d < dimension_; ++d)
+        point[d] = frame[d * feature_stride];
+    }
+    for(unsigned int g = 0; g < mixtures; ++g)
+    {
+      unsigned int width = mixture_end(g) - mixture_begin(g);
+      double *out = log_likelihood + static_cast<size_t>(start) * mixtures + g;
+      if(width == 0)
+      {
+        for(unsigned int f = 0; f < size; ++f)
+          out[f * mixtures] = -std::numeric_limits<double>::infinity();
+        continue;
+      }
+      ComponentLogLikelihoods(points.data(), size, mixture_begin(g),
+          mixture_end(g), &tile[0]);
+      for(unsigned int f = 0; f < size; ++f)
+        out[f * mixtures] = utilities::LogSumExp(
+            &tile[static_cast<size_t>(f) * width], width);
+    }
+  }
+}
+
+// For diagonal Gaussians a and b,
+//   KL(a||b) + KL(b||a) = 0.5 * sum_d [ va/vb + vb/va
+//       + (ma - mb)^2 * (1/va + 1/vb) - 2 ]
+// The log determinant terms of the two directions cancel, so no logs or
+// products are needed. Padded dimensions have zero variance and zero inverse
+// variance and add nothing to the sum.
+static double PackedSymmetricKL(const double *mean_a, const double *variance_a,
+    const double *mean_b, const double *variance_b, unsigned int dimension,
+    unsigned int padded_dimension)
+{
+  const double *inverse_a = mean_a + padded_dimension;
+  const double *inverse_b = mean_b + padded_dimension;
+  double sum[4] = {0, 0, 0, 0};
+  for(unsigned int d = 0; d < padded_dimension; d += 4)
+    for(unsigned int j = 0; j < 4; ++j)
+    {
+      double difference = mean_a[d+j] - mean_b[d+j];
+      sum[j] += variance_a[d+j] * inverse_b[d+j] + 
+          variance_b[d+j] * inverse_a[d+j] + difference * difference *
+          (inverse_a[d+j] + inverse_b[d+j]);
+    }
+  return 0.5 * (((sum[0] + sum[1]) + (sum[2] + sum[3])) - 2.0 * dimension);
+}
+
+// The upper triangle is split into square tiles that the threads take in turn.
+void PackedMixtureSet::SymmetricKLDivergences(
+    utilities::Matrix<double> &divergence, unsigned int threads) const
+{
+  unsigned int components = num_components();
+  divergence.Initialize(components, components, 0);
+  if(components == 0)
+    return;
+  utilities::AlignedArray<double> variance;
+  variance.Initialize(static_cast<size_t>(components) * padded_dimension_, 0);
+  for(unsigned int c = 0; c < components; ++c)
+    for(unsigned int d = 0; d < dimension_; ++d)
+      variance[static_cast<size_t>(c) * padded_dimension_ + d] = 
+          1 / inverse_variance(c)[d];
+
+  const unsigned int tile = 64;
+  unsigned int tiles = (components + tile - 1) / tile;
+  std::vector<std::pair<unsigned int, unsigned int> > work;
+  for(unsigned int r = 0; r < tiles; ++r)
+    for(unsigned int c = r; c < tiles; ++c)
+      work.push_back(std::make_pair(r, c));
+  if(threads == 0)
+    threads = std::thread::hardware_concurrency();
+  threads = std::max(1u, std::min<unsigned int>(threads, work.size()));
+
+  std::atomic<unsigned int> next(0);
+  std::vector<std::thread> pool;
+  for(unsigned int t = 0; t < threads; ++t)
+    pool.push_back(std::thread([&]()
+    {
+      for(unsigned int w = next++; w < work.size(); w = next++)
+      {
+        unsigned int row_end = std::min(components, (work[w].first + 1) * tile);
+        unsigned int col_end = std::min(components, 
+            (work[w].second + 1) * tile);
+        for(unsigned int r = work[w].first * tile; r < row_end; ++r)
+        {
+          const double *variance_r = variance.data() + 
+              static_cast<size_t>(r) * padded_dimension_;
+          for(unsigned int c = std::max(r + 1, work[w].second * tile);
+              c < col_end; ++c)
+          {
+            double value = PackedSymmetricKL(mean(r), variance_r, mean(c),
+                variance.data() + static_cast<size_t>(c) * padded_dimension_,
+                dimension_, padded_dimension_);
+            divergence(r, c) = value;
+            divergence(c, r) = value;
+          }
+        }
+      }
+    }));
+  for(unsigned int t = 0; t < threads; ++t)
+    pool[t].join();
+}
+
+} // end namespace statistics
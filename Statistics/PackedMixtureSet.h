@@ -0,0 +1,157 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef STATISTICS_PACKEDMIXTURESET_H_
+#define STATISTICS_PACKEDMIXTURESET_H_
+
+#include<vector>
+#include<limits>
+#include<utility>
+#include<algorithm>
+#include<thread>
+#include<atomic>
+#include<memory>
+#include<ostream>
+#include "stdint.h"
+#include "MixtureOfDiagonalGaussians.h"
+#include "AlignedArray.h"
+#include "MappedFile.h"
+#include "Matrix.h"
+#include "LogMath.h"
+
+// Holds the parameters of a set of mixtures of diagonal Gaussians in a single
+// aligned block of memory. A MixtureOfDiagonalGaussians keeps every component
+// in its own pair of vectors, so a large model is spread over thousands of
+// allocations. Here the components of every mixture are stored one after
+// another. Component c is its mean followed by its inverse variance, each
+// padded with zeros to padded_dimension(), a multiple of eight doubles. Every
+// component therefore starts on a 64 byte boundary and a kernel can run over
+// the padded length without a remainder loop. The log weight and log
+// normalization constant of each component are kept in separate arrays. The
+// set is read only once built, so copies share the same arrays.
+//
+// The arrays can also be written to a binary file and used in place from a
+// memory mapped copy of that file, so a set loads without being rebuilt and
+// processes that map the same file share one copy in the page cache.
+//
+// The distance kernel is chosen when the set is built. The common feature
+// dimensions have versions where the padded length is a compile time constant,
+// and every other dimension uses a generic version.
+
+namespace statistics
+{
+
+class PackedMixtureSet
+{
+ private:
+  unsigned int dimension_;
+  unsigned int padded_dimension_;
+  unsigned int mixtures_;
+  unsigned int components_;
+  // Owner of the arrays below, either a block filled by Initialize or a mapped
+  // file.
+  std::shared_ptr<const void> storage_;
+  // The components of mixture g are [mixture_offset_[g], mixture_offset_[g+1]).
+  const uint32_t *mixture_offset_;
+  const uint32_t *component_mixture_;
+  const double *parameters_;
+  const double *log_weight_;
+  const double *log_constant_;
+
+  // Returns the sum over d of (point[d] - mean[d])^2 * inverse_variance[d] for
+  // a packed component starting at mean.
+  typedef double (*DistanceKernel)(const double *mean, const double *point,
+      unsigned int padded_dimension);
+  DistanceKernel distance_;
+  // Writes the distance from one component to count padded points, one every
+  // stride values of distance.
+  typedef void (*BlockDistanceKernel)(const double *mean, const double *points,
+      unsigned int count, unsigned int padded_dimension, double *distance,
+      size_t stride);
+  BlockDistanceKernel block_distance_;
+  bool fixed_kernel_;
+
+  // Sets distance_ and block_distance_ based on padded_dimension_.
+  void SelectKernel();
+
+ public:
+  PackedMixtureSet() { Initialize(std::vector<MixtureOfDiagonalGaussians>()); }
+  ~PackedMixtureSet() {}
+
+  // Copies the parameters of every mixture. All of the Gaussians must have the
+  // same dimension. Returns false if they do not.
+  bool Initialize(const std::vector<MixtureOfDiagonalGaussians> &mog);
+
+  // Writes the arrays with fileutilities::WriteAlignedArray. out must be a
+  // binary stream positioned relative to the start of the file.
+  void WriteBinary(std::ostream &out) const;
+
+  // Uses the arrays written by WriteBinary at offset of file in place, and
+  // moves offset past them. The set keeps the file mapped. Returns false, and
+  // leaves the set empty, if the arrays are truncated or inconsistent.
+  bool MapBinary(const std::shared_ptr<const fileutilities::MappedFile> &file,
+      size_t &offset);
+
+  // Standard accessor functions.
+  unsigned int dimension() const { return dimension_; }
+  unsigned int padded_dimension() const { return padded_dimension_; }
+  unsigned int num_mixtures() const { return mixtures_; }
+  unsigned int num_components() const { return components_; }
+  unsigned int mixture_begin(unsigned int g) const {
+      return mixture_offset_[g]; }
+  unsigned int mixture_end(unsigned int g) const {
+      return mixture_offset_[g+1]; }
+  unsigned int component_mixture(unsigned int c) const {
+      return component_mixture_[c]; }
+  const double* mean(unsigned int c) const { return parameters_ +
+      static_cast<size_t>(c) * 2 * padded_dimension_; }
+  const double* inverse_variance(unsigned int c) const { return mean(c) +
+      padded_dimension_; }
+  double log_weight(unsigned int c) const { return log_weight_[c]; }
+  double log_constant(unsigned int c) const { return log_constant_[c]; }
+  // True if a kernel specialized for the dimension is used.
+  bool fixed_kernel() const { return fixed_kernel_; }
+
+  // Copies a point of dimension() values into padded, which must hold
+  // padded_dimension() values, and fills the padding with zeros.
+  void PadPoint(const double *point, double *padded) const;
+
+  // Weighted log likelihood, log weight + log N(point), of component c. point
+  // must be padded as by PadPoint.
+  double ComponentLogLikelihood(unsigned int c, const double *point) const;
+
+  // Log likelihood of mixture g for a padded point.
+  double MixtureLogLikelihood(unsigned int g, const double *point) const;
+
+  // Scores a block of count padded points, stored one after another, against
+  // components [begin, end). tile receives a (frame x component) block of
+  // weighted log likelihoods with end - begin values per frame. Each
+  // component is loaded once for the whole block, so blocks of 8 to 32 frames
+  // read the model parameters far less often than scoring frame by frame.
+  void ComponentLogLikelihoods(const double *points, unsigned int count,
+      unsigned int begin, unsigned int end, double *tile) const;
+
+  // Computes the log likelihood of every mixture for count frames stored one
+  // after another with dimension() values each. log_likelihood is resized to
+  // (frame x mixture). The frames are scored in blocks.
+  void LogLikelihoods(const double *frames, unsigned int count,
+      utilities::Matrix<double> &log_likelihood) const;
+
+  // Same as above, but element d of frame f is read from
+  // data[f * frame_stride + d * feature_stride], so the frames can be either
+  // the rows or the columns of a matrix. log_likelihood receives
+  // num_mixtures() values per frame.
+  void LogLikelihoods(const double *data, size_t frame_stride,
+      size_t feature_stride, unsigned int count, double *log_likelihood) const;
+
+  // Fills divergence with the (component x component) matrix of symmetric KL
+  // divergences, KL(a||b) + KL(b||a), between every pair of components,
+  // regardless of the mixture they belong to. The work is split across
+  // threads; 0 uses one thread per core.
+  void SymmetricKLDivergences(utilities::Matrix<double> &divergence,
+      unsigned int threads = 0) const;
+};
+
+} // end namespace statistics
+#endif
@@ -3,6 +3,7 @@
 // See the UNLICENSE file for more information.
 
 #include "PosteriorgramGenerator.h"
+#include "PosteriorgramStatistics.h"
 
 namespace statistics
 {
@@ -15,6 +16,7 @@ bool PosteriorgramGenerator::SetGaussians(
   // Since no index is specified, we assume each MOG is its own distinct label.
   for(unsigned int i = 0; i < mog_.size(); ++i)
     posterior_index_[i] = i;
+  PackGaussians();
   return true;
 }
 
@@ -23,28 +25,489 @@ bool PosteriorgramGenerator::SetGaussians(
 {
   mog_ = mog;
   posterior_index_ = indices;
+  PackGaussians();
   return true;
 }
 
-// The similarity matrix is always symmetric so we only compute one half and 
-// fill in the rest of the values based on the result.
-utilities::Matrix<double> PosteriorgramGenerator::ComputeSimilarityMatrix()
+// Component i of mixture g keeps its position within the mixture and moves to
+// the block of its posterior, so the shortlists only need their indices
+// mapped. The codewords depend on the means alone and stay as they are.
+bool PosteriorgramGenerator::AggregateClusters(const std::vector<double> &prior)
+{
+  unsigned int mixtures = mog_.size();
+  if(!prior.empty() && prior.size() != mixtures)
+    return false;
+  for(unsigned int g = 0; g < prior.size(); ++g)
+    if(!(prior[g] > 0))
+      return false;
+
+  std::vector<MixtureOfDiagonalGaussians> cluster(num_posteriors_);
+  std::vector<unsigned int> new_component(packed_.num_components());
+  unsigned int next = 0;
+  for(unsigned int p = 0; p < num_posteriors_; ++p)
+    for(unsigned int m = 0; m < posterior_members_[p].size(); ++m)
+    {
+      unsigned int g = posterior_members_[p][m];
+      double scale = prior.empty() ? 1.0 / mixtures : prior[g];
+      for(unsigned int i = 0; i < mog_[g].components(); ++i)
+      {
+        cluster[p].AddGaussian(mog_[g].gaussian(i), mog_[g].weight(i) * scale);
+        new_component[packed_.mixture_begin(g) + i] = next++;
+      }
+    }
+
+  utilities::Matrix<double> codebook = codebook_;
+  std::vector<double> codebook_scale = codebook_scale_;
+  std::vector<std::vector<unsigned int> > shortlist = shortlist_;
+  mog_.swap(cluster);
+  posterior_index_.resize(num_posteriors_);
+  for(unsigned int p = 0; p < num_posteriors_; ++p)
+    posterior_index_[p] = p;
+  PackGaussians();
+
+  for(unsigned int k = 0; k < shortlist.size(); ++k)
+  {
+    for(unsigned int i = 0; i < shortlist[k].size(); ++i)
+      shortlist[k][i] = new_component[ shortlist[k][i] ];
+    std::sort(shortlist[k].begin(), shortlist[k].end());
+  }
+  codebook_ = codebook;
+  codebook_scale_ = codebook_scale;
+  shortlist_.swap(shortlist);
+  return true;
+}
+
+void PosteriorgramGenerator::PackGaussians()
+{
+  packed_.Initialize(mog_);
+  ClearGaussianSelection();
+  num_posteriors_ = 0;
+  for(unsigned int i = 0; i < posterior_index_.size(); ++i)
+    if( posterior_index_[i] > static_cast<int>(num_posteriors_))
+      num_posteriors_ = posterior_index_[i];
+  num_posteriors_++; // Number of posteriors is the highest index + 1.
+  posterior_members_.assign(num_posteriors_, std::vector<unsigned int>());
+  for(unsigned int g = 0; g < mog_.size(); ++g)
+    posterior_members_[ posterior_index_[g] ].push_back(g);
+
+  unsigned int components = packed_.num_components();
+  unsigned int dimension = packed_.dimension();
+  linear_weight_.Initialize(2 * dimension, components);
+  component_constant_.resize(components);
+  for(unsigned int c = 0; c < components; ++c)
+  {
+    const double *mean = packed_.mean(c);
+    const double *inverse_variance = packed_.inverse_variance(c);
+    double constant = packed_.log_weight(c) + packed_.log_constant(c);
+    for(unsigned int d = 0; d < dimension; ++d)
+    {
+      linear_weight_(d, c) = mean[d] * inverse_variance[d];
+      linear_weight_(dimension + d, c) = -0.5 * inverse_variance[d];
+      constant -= 0.5 * mean[d] * mean[d] * inverse_variance[d];
+    }
+    component_constant_[c] = constant;
+  }
+}
+
+// The codebook is trained with k-means over the component means, seeded with
+// evenly spaced components so the result does not depend on a random seed.
+// Distances are scaled by the inverse of the average variance of each
+// dimension so no single feature dominates the clustering.
+bool PosteriorgramGenerator::BuildGaussianSelection(unsigned int codewords,
+    unsigned int shortlist, unsigned int iterations)
+{
+  ClearGaussianSelection();
+  unsigned int components = packed_.num_components();
+  if(components == 0 || codewords == 0 || shortlist == 0)
+    return false;
+  unsigned int dimension = packed_.dimension();
+  codewords = std::min(codewords, components);
+  shortlist = std::min(shortlist, components);
+
+  codebook_scale_.assign(dimension, 0);
+  for(unsigned int c = 0; c < components; ++c)
+    for(unsigned int d = 0; d < dimension; ++d)
+      codebook_scale_[d] += 1 / packed_.inverse_variance(c)[d];
+  for(unsigned int d = 0; d < dimension; ++d)
+    codebook_scale_[d] = components / codebook_scale_[d];
+
+  codebook_.Initialize(codewords, dimension);
+  for(unsigned int k = 0; k < codewords; ++k)
+  {
+    unsigned int c = static_cast<unsigned int>(
+        (static_cast<unsigned long>(k) * components) / codewords);
+    for(unsigned int d = 0; d < dimension; ++d)
+      codebook_(k, d) = packed_.mean(c)[d];
+  }
+
+  utilities::Matrix<double> total;
+  std::vector<unsigned int> count;
+  for(unsigned int iter = 0; iter < iterations; ++iter)
+  {
+    total.Initialize(codewords, dimension, 0);
+    count.assign(codewords, 0);
+    for(unsigned int c = 0; c < components; ++c)
+    {
+      const double *mean = packed_.mean(c);
+      unsigned int k = NearestCodeword(mean);
+      count[k]++;
+      for(unsigned int d = 0; d < dimension; ++d)
+        total(k, d) += mean[d];
+    }
+    // A codeword that lost every component keeps its previous position.
+    for(unsigned int k = 0; k < codewords; ++k)
+      if(count[k] > 0)
+        for(unsigned int d = 0; d < dimension; ++d)
+          codebook_(k, d) = total(k, d) / count[k];
+  }
+
+  // Keep the components that contribute the most mass at each codeword. The
+  // shortlist is stored in component order so the mixtures stay grouped.
+  shortlist_.resize(codewords);
+  std::vector<std::pair<double, unsigned int> > scores(components);
+  utilities::AlignedArray<double> point;
+  point.Initialize(packed_.padded_dimension());
+  for(unsigned int k = 0; k < codewords; ++k)
+  {
+    packed_.PadPoint(codebook_.data() + static_cast<size_t>(k) * dimension,
+        point.data());
+    for(unsigned int c = 0; c < components; ++c)
+      scores[c] = std::make_pair(
+          packed_.ComponentLogLikelihood(c, point.data()), c);
+    std::partial_sort(scores.begin(), scores.begin() + shortlist, 
+        scores.end(), std::greater<std::pair<double, unsigned int> >());
+    shortlist_[k].resize(shortlist);
+    for(unsigned int i = 0; i < shortlist; ++i)
+      shortlist_[k][i] = scores[i].second;
+    std::sort(shortlist_[k].begin(), shortlist_[k].end());
+  }
+  return true;
+}
+
+void PosteriorgramGenerator::ClearGaussianSelection()
+{
+  codebook_.Initialize(0, 0);
+  codebook_scale_.clear();
+  shortlist_.clear();
+}
+
+unsigned int PosteriorgramGenerator::NearestCodeword(const double *point) const
+{
+  unsigned int dimension = codebook_.NumCols();
+  unsigned int best = 0;
+  double best_distance = std::numeric_limits<double>::infinity();
+  for(unsigned int k = 0; k < codebook_.NumRows(); ++k)
+  {
+    const double *codeword = codebook_.data() + static_cast<size_t>(k) * 
+        dimension;
+    double distance = 0;
+    for(unsigned int d = 0; d < dimension; ++d)
+    {
+      double diff = point[d] - codeword[d];
+      distance += diff * diff * codebook_scale_[d];
+    }
+    if(distance < best_distance)
+    {
+      best_distance = distance;
+      best = k;
+    }
+  }
+  return best;
+}
+
+utilities::Matrix<double> PosteriorgramGenerator::ComputeLogLikelihoods(
+    const utilities::Matrix<double> &data) const
+{
+  return LogLikelihoods(data, UsesGaussianSelection());
+}
+
+void PosteriorgramGenerator::ComputeFrameLogLikelihoods(const double *frames,
+    unsigned int count, utilities::Matrix<double> &log_likelihood) const
+{
+  log_likelihood.Initialize(count, mog_.size());
+  if(count == 0 || mog_.size() == 0)
+    return;
+  FrameScores(frames, dimension(), 1, count, UsesGaussianSelection(),
+      log_likelihood.data());
+}
+
+// The frames are scored in blocks and the (frame x mixture) result of each
+// block is copied into the (mixture x frame) matrix that is returned.
+utilities::Matrix<double> PosteriorgramGenerator::LogLikelihoods(
+    const utilities::Matrix<double> &data, bool use_selection) const
 {
   utilities::Matrix<double> ret;
-  double max_divergence = 0;
-  ret.Initialize(mog_.size(), mog_.size());
-  for(unsigned int r = 0; r < mog_.size(); ++r)
-    for(unsigned int c = r; c < mog_.size(); ++c)
+  unsigned int frames = data.NumCols();
+  unsigned int mixtures = mog_.size();
+  unsigned int frame_block = 64;
+  ret.Initialize(mixtures, frames);
+  if(frames == 0 || mixtures == 0)
+    return ret;
+
+  std::vector<double> block_scores(frame_block * mixtures);
+  for(unsigned int start = 0; start < frames; start += frame_block)
+  {
+    unsigned int block = std::min(frame_block, frames - start);
+    FrameScores(data.data() + start, 1, frames, block, use_selection, 
+        &block_scores[0]);
+    for(unsigned int f = 0; f < block; ++f)
+      for(unsigned int g = 0; g < mixtures; ++g)
+        ret(g, start + f) = block_scores[f * mixtures + g];
+  }
+  return ret;
+}
+
+// Without selection the frames are processed in blocks so that the matrix of
+// component scores stays small regardless of the number of frames.
+void PosteriorgramGenerator::FrameScores(const double *data, 
+    size_t frame_stride, size_t feature_stride, unsigned int count, 
+    bool use_selection, double *log_likelihood) const
+{
+  unsigned int dimension = packed_.dimension();
+  unsigned int components = packed_.num_components();
+  unsigned int mixtures = mog_.size();
+
+  if(use_selection)
+  {
+    double negative_infinity = -std::numeric_limits<double>::infinity();
+    std::vector<double> scores, mixture_max(mixtures), mixture_sum(mixtures);
+    // The padding past dimension stays zero.
+    utilities::AlignedArray<double> point;
+    point.Initialize(packed_.padded_dimension(), 0);
+    for(unsigned int f = 0; f < count; ++f)
+    {
+      for(unsigned int d = 0; d < dimension; ++d)
+        point[d] = data[f * frame_stride + d * feature_stride];
+      const std::vector<unsigned int> &list = shortlist_[
+          NearestCodeword(point.data()) ];
+      scores.resize(list.size());
+      std::fill(mixture_max.begin(), mixture_max.end(), negative_infinity);
+      std::fill(mixture_sum.begin(), mixture_sum.end(), 0);
+      for(unsigned int i = 0; i < list.size(); ++i)
+      {
+        scores[i] = packed_.ComponentLogLikelihood(list[i], point.data());
+        unsigned int g = packed_.component_mixture(list[i]);
+        mixture_max[g] = std::max(mixture_max[g], scores[i]);
+      }
+      for(unsigned int i = 0; i < list.size(); ++i)
+      {
+        unsigned int g = packed_.component_mixture(list[i]);
+        mixture_sum[g] += std::exp(scores[i] - mixture_max[g]);
+      }
+      double floor = std::numeric_limits<double>::infinity();
+      for(unsigned int g = 0; g < mixtures; ++g)
+        if(mixture_sum[g] > 0)
+        {
+          mixture_max[g] += std::log(mixture_sum[g]);
+          floor = std::min(floor, mixture_max[g]);
+        }
+      double *frame_scores = log_likelihood + static_cast<size_t>(f) * 
+          mixtures;
+      for(unsigned int g = 0; g < mixtures; ++g)
+        frame_scores[g] = (mixture_sum[g] > 0) ? mixture_max[g] : floor;
+    }
+    return;
+  }
+
+  // With a kernel specialized for the dimension, scoring blocks of frames
+  // directly against the packed components is faster than the matrix product.
+  if(packed_.fixed_kernel())
+  {
+    packed_.LogLikelihoods(data, frame_stride, feature_stride, count,
+        log_likelihood);
+    return;
+  }
+
+  unsigned int frame_block = 64;
+  utilities::Matrix<double> features, scores;
+  for(unsigned int start = 0; start < count; start += frame_block)
+  {
+    unsigned int block = std::min(frame_block, count - start);
+    features.Initialize(block, 2 * dimension);
+    for(unsigned int f = 0; f < block; ++f)
+    {
+      const double *frame = data + (start + f) * frame_stride;
+      for(unsigned int d = 0; d < dimension; ++d)
+      {
+        double value = frame[d * feature_stride];
+        features(f, d) = value;
+        features(f, dimension + d) = value * value;
+      }
+    }
+    utilities::BlockedMatrixProduct(features, linear_weight_, scores);
+
+    for(unsigned int f = 0; f < block; ++f)
     {
-      ret(r,c) = mog_[r].CSDivergence(mog_[c]);
-      if( ret(r,c) > max_divergence)
-        max_divergence = ret(r,c);
+      double *row = scores.data() + (static_cast<size_t>(f) * components);
+      double *frame_scores = log_likelihood + 
+          static_cast<size_t>(start + f) * mixtures;
+      for(unsigned int c = 0; c < components; ++c)
+        row[c] += component_constant_[c];
+      for(unsigned int g = 0; g < mixtures; ++g)
+        frame_scores[g] = utilities::LogSumExp(row + packed_.mixture_begin(g),
+            packed_.mixture_end(g) - packed_.mixture_begin(g));
     }
+  }
+}
+
+double PosteriorgramGenerator::GaussianSelectionError(
+    const utilities::Matrix<double> &data, double &max_error, 
+    double &one_best_agreement) const
+{
+  max_error = 0;
+  one_best_agreement = 1;
+  if(mog_.size() == 0 || data.NumCols() == 0)
+    return 0;
+  utilities::Matrix<double> full = PosteriorgramFromLogLikelihoods(
+      LogLikelihoods(data, false));
+  utilities::Matrix<double> selected = PosteriorgramFromLogLikelihoods(
+      ComputeLogLikelihoods(data));
+
+  double total_error = 0;
+  unsigned int agree = 0;
+  for(unsigned int f = 0; f < full.NumCols(); ++f)
+  {
+    unsigned int full_best = 0, selected_best = 0;
+    for(unsigned int p = 0; p < full.NumRows(); ++p)
+    {
+      double error = std::abs(full(p, f) - selected(p, f));
+      total_error += error;
+      max_error = std::max(max_error, error);
+      if(full(p, f) > full(full_best, f))
+        full_best = p;
+      if(selected(p, f) > selected(selected_best, f))
+        selected_best = p;
+    }
+    if(full_best == selected_best)
+      agree++;
+  }
+  one_best_agreement = static_cast<double>(agree) / full.NumCols();
+  return total_error / (static_cast<double>(full.NumRows()) * full.NumCols());
+}
+
+// The integral of the product of two Gaussians is N(mu_a; mu_b, var_a + var_b),
+// so the Cauchy-Schwarz divergence between mixtures a and b is
+//   -log(sum_ij w_i w_j z_ij) + 0.5 log(sum_ik w_i w_k z_ik)
+//   + 0.5 log(sum_jl w_j w_l z_jl)
+// The last two terms depend on a single mixture and are computed once. Every
+// sum is taken in the log domain, so distant mixtures do not underflow to zero.
+double PosteriorgramGenerator::LogProductIntegral(unsigned int a,
+    unsigned int b, const double *variance) const
+{
+  unsigned int padded_dimension = packed_.padded_dimension();
+  const double *mean_a = packed_.mean(a);
+  const double *mean_b = packed_.mean(b);
+  const double *variance_a = variance + static_cast<size_t>(a) *
+      padded_dimension;
+  const double *variance_b = variance + static_cast<size_t>(b) *
+      padded_dimension;
+  // The log of the summed variances is taken once per group of eight as the
+  // log of their product.
+  double distance = 0, log_determinant = 0;
+  for(unsigned int d = 0; d < padded_dimension; d += 8)
+  {
+    double sum[8], product = 1, group = 0;
+    for(unsigned int j = 0; j < 8; ++j)
+      sum[j] = variance_a[d+j] + variance_b[d+j];
+    for(unsigned int j = 0; j < 8; ++j)
+    {
+      double difference = mean_a[d+j] - mean_b[d+j];
+      group += difference * difference / sum[j];
+      product *= sum[j];
+    }
+    distance += group;
+    log_determinant += std::log(product);
+  }
+  double pi = 4.0 * atan(1.0);
+  return -0.5 * (packed_.dimension() * std::log(2*pi) + log_determinant + 
+      distance);
+}
+
+double PosteriorgramGenerator::LogMixtureProductIntegral(unsigned int a,
+    unsigned int b, const double *variance, std::vector<double> &buffer) const
+{
+  buffer.clear();
+  for(unsigned int i = packed_.mixture_begin(a); i < packed_.mixture_end(a); 
+      ++i)
+    for(unsigned int j = packed_.mixture_begin(b); j < packed_.mixture_end(b);
+        ++j)
+      buffer.push_back(packed_.log_weight(i) + packed_.log_weight(j) +
+          LogProductIntegral(i, j, variance));
+  if(buffer.empty())
+    return -std::numeric_limits<double>::infinity();
+  return utilities::LogSumExp(buffer);
+}
+
+// The similarity matrix is always symmetric so we only compute one half and 
+// fill in the rest of the values based on the result. The upper triangle is
+// split into square tiles that the threads take in turn.
+utilities::Matrix<double> PosteriorgramGenerator::ComputeSimilarityMatrix(
+    unsigned int threads)
+{
+  utilities::Matrix<double> ret;
+  unsigned int mixtures = mog_.size();
+  ret.Initialize(mixtures, mixtures, 0);
+  if(mixtures == 0)
+    return ret;
+
+  // Variances padded with 0.5, so every padded dimension adds log(1) = 0.
+  unsigned int dimension = packed_.dimension();
+  unsigned int padded_dimension = packed_.padded_dimension();
+  unsigned int components = packed_.num_components();
+  utilities::AlignedArray<double> variance;
+  variance.Initialize(static_cast<size_t>(components) * padded_dimension, 0.5);
+  for(unsigned int c = 0; c < components; ++c)
+    for(unsigned int d = 0; d < dimension; ++d)
+      variance[static_cast<size_t>(c) * padded_dimension + d] = 
+          1 / packed_.inverse_variance(c)[d];
+
+  std::vector<double> self(mixtures);
+  std::vector<double> buffer;
+  for(unsigned int g = 0; g < mixtures; ++g)
+    self[g] = LogMixtureProductIntegral(g, g, variance.data(), buffer);
+
+  const unsigned int tile = 32;
+  unsigned int tiles = (mixtures + tile - 1) / tile;
+  std::vector<std::pair<unsigned int, unsigned int> > work;
+  for(unsigned int r = 0; r < tiles; ++r)
+    for(unsigned int c = r; c < tiles; ++c)
+      work.push_back(std::make_pair(r, c));
+
+  if(threads == 0)
+    threads = std::thread::hardware_concurrency();
+  threads = std::max(1u, std::min<unsigned int>(threads, work.size()));
+  std::atomic<unsigned int> next(0);
+  std::vector<double> thread_max(threads, 0);
+  std::vector<std::thread> pool;
+  for(unsigned int t = 0; t < threads; ++t)
+    pool.push_back(std::thread([&, t]()
+    {
+      std::vector<double> pair_buffer;
+      for(unsigned int w = next++; w < work.size(); w = next++)
+      {
+        unsigned int row_end = std::min(mixtures, (work[w].first + 1) * tile);
+        unsigned int col_end = std::min(mixtures, (work[w].second + 1) * tile);
+        for(unsigned int r = work[w].first * tile; r < row_end; ++r)
+          for(unsigned int c = std::max(r + 1, work[w].second * tile);
+              c < col_end; ++c)
+          {
+            ret(r,c) = -LogMixtureProductIntegral(r, c, variance.data(),
+                pair_buffer) + 0.5 * (self[r] + self[c]);
+            if( ret(r,c) > thread_max[t])
+              thread_max[t] = ret(r,c);
+          }
+      }
+    }));
+  for(unsigned int t = 0; t < threads; ++t)
+    pool[t].join();
+  double max_divergence = *std::max_element(thread_max.begin(),
+      thread_max.end());
+
   // Normalize the matrix so that the values are between 0 and 1.
   for(unsigned int r = 0; r < ret.NumRows(); ++r)
     for(unsigned int c = r; c < ret.NumCols(); ++c)
     {
-      ret(r,c) = 1 - ( ret(r,c) / max_divergence );
+      ret(r,c) = (max_divergence > 0) ? 1 - ( ret(r,c) / max_divergence ) : 1;
       ret(c,r) = ret(r,c);
     }
 
@@ -54,97 +517,110 @@ utilities::Matrix<double> PosteriorgramGenerator::ComputeSimilarityMatrix()
 // Assume data is in a (feature x frame) format.
 utilities::Matrix<double> PosteriorgramGenerator::ComputePosteriorgram(
     const utilities::Matrix<double> &data) const
+{
+  if(mog_.size() == 0)
+    return utilities::Matrix<double>(1, data.NumCols(), 0);
+  return PosteriorgramFromLogLikelihoods(ComputeLogLikelihoods(data));
+}
+
+utilities::Matrix<double> 
+PosteriorgramGenerator::PosteriorgramFromLogLikelihoods(
+    const utilities::Matrix<double> &log_likelihood) const
 {
   utilities::Matrix<double> ret;
+  unsigned int frames = log_likelihood.NumCols();
+  ret.Initialize(num_posteriors_, frames, 0);
+  std::vector<double> frame_data(mog_.size()), posterior(num_posteriors_);
+  for(unsigned int f = 0; f < frames; ++f)
+  {
+    for(unsigned int g = 0; g < mog_.size(); ++g)
+      frame_data[g] = log_likelihood(g, f);
+    FramePosteriors(&frame_data[0], &posterior[0]);
+    for(unsigned int p = 0; p < num_posteriors_; ++p)
+      ret(p, f) = posterior[p];
+  }
+  return ret;
+}
 
-  // First identify the total number of posteriors.
-  int posteriors = 0;
+void PosteriorgramGenerator::FramePosteriors(const double *log_likelihood,
+    double *posterior) const
+{
+  // Scale every likelihood in the frame by the largest one before leaving
+  // the log domain.
+  double max_value = log_likelihood[0];
+  for(unsigned int g = 1; g < mog_.size(); ++g)
+    max_value = std::max(max_value, log_likelihood[g]);
+  std::fill(posterior, posterior + num_posteriors_, 0.0);
+  double total_value = 0;
+  for(unsigned int g = 0; g < mog_.size(); ++g)
+  {
+    double like = std::exp(log_likelihood[g] - max_value);
+    posterior[ posterior_index_[g] ] += like;
+    total_value +=  like;
+  }
+  // Normalize the frame by total mass in frame.
+  for(unsigned int p = 0; p < num_posteriors_; ++p)
+    posterior[p] = posterior[p] / total_value;
+}
+
+utilities::Matrix<double> PosteriorgramGenerator::ComputeLogPosteriorgram(
+    const utilities::Matrix<double> &data, double floor) const
+{
+  utilities::Matrix<double> ret;
   int frames = data.NumCols();
-  for(unsigned int i = 0; i < posterior_index_.size(); ++i)
-    if( posterior_index_[i] > posteriors)
-      posteriors = posterior_index_[i]; 
-  posteriors++; // Number of posteriors is the highest index + 1.
-  
-  ret.Initialize(posteriors, frames, 0);
+  ret.Initialize(num_posteriors_, frames, floor);
+  if(mog_.size() == 0)
+    return ret;
+
+  utilities::Matrix<double> log_likelihood = ComputeLogLikelihoods(data);
+  std::vector<double> frame_data(mog_.size()), buffer(mog_.size());
   for(int f = 0; f < frames; ++f)
   {
-    std::vector<double> frame_data = data.GetCol(f);
-    double total_value = 0;
     for(unsigned int g = 0; g < mog_.size(); ++g)
+      frame_data[g] = log_likelihood(g, f);
+    double total = utilities::LogSumExp(frame_data);
+    // Leaves the frame at floor rather than computing -inf - -inf.
+    if(total == -std::numeric_limits<double>::infinity())
+      continue;
+    for(unsigned int p = 0; p < num_posteriors_; ++p)
     {
-      double like =  mog_[g].Likelihood(frame_data);
-      ret(posterior_index_[g], f) += like;
-      total_value +=  like;
+      const std::vector<unsigned int> &members = posterior_members_[p];
+      for(unsigned int i = 0; i < members.size(); ++i)
+        buffer[i] = frame_data[ members[i] ];
+      double value = utilities::LogSumExp(&buffer[0], members.size()) - total;
+      ret(p, f) = std::max(value, floor);
     }
-    // Normalize the frame by total mass in frame.
-    for(int p = 0; p < posteriors; ++p)
-      ret(p, f) = ( ret(p, f) / total_value );
-
   }
   return ret;
 }
 
+// The three functions below share the single pass of PosteriorgramStatistics.
+// Use that class directly when more than one of them is needed.
 std::vector<int> PosteriorgramGenerator::BestIndexPerFrame(
     const utilities::Matrix<double> &pgram)
 {
-  std::vector<int> ret;
-  ret.resize( pgram.NumCols() );
-
-  for(unsigned int f = 0; f < ret.size(); ++f)
-  {
-    double bestval = -1;
-    for(unsigned p = 0; p < pgram.NumRows(); ++p)
-    {
-      if( pgram(p, f) > bestval )
-      {
-        bestval = pgram(p, f);
-        ret[f] = p;
-      }
-    }
-  }
-  return ret;
+  PosteriorgramStatistics statistics;
+  statistics.Reset(pgram.NumRows(), false);
+  statistics.Accumulate(pgram);
+  return statistics.best_index();
 }
 
-std::vector< std::pair<int, int> > PosteriorgramGenerator::BestIndexCount(                             
+std::vector< std::pair<int, int> > PosteriorgramGenerator::BestIndexCount(
       const utilities::Matrix<double> &pgram)
 {
-  std::vector< std::pair<int, int> > ret;
-  std::vector<int> one_best = BestIndexPerFrame(pgram);
-  
-  ret.resize(pgram.NumRows());
-  // Initialize the vector of pairs
-  for(unsigned int i = 0; i < ret.size(); ++i)
-    ret[i] = std::make_pair(i, 0);
-  for(unsigned int i = 0; i < one_best.size(); ++i)
-    ret[ one_best[i] ].second++;
-
-  std::sort(ret.begin(), ret.end(), CompareIndexCountPair);
-  return ret;
+  PosteriorgramStatistics statistics;
+  statistics.Reset(pgram.NumRows(), false);
+  statistics.Accumulate(pgram);
+  return statistics.SortedBestCount();
 }
 
 std::vector<std::pair<int, double> > PosteriorgramGenerator::BestIndexMass(
     const utilities::Matrix<double> &pgram)
 {
-  std::vector<std::pair<int, double> > ret;
-  ret.resize(pgram.NumRows());
-  double total_mass = 0;
-  // Initialize the vector of pairs.
-  for(unsigned int i = 0; i < ret.size(); ++i)
-    ret[i] = std::make_pair(i,0);
-
-  for(unsigned int f = 0; f < pgram.NumCols(); ++f)
-    for(unsigned int p = 0; p < pgram.NumRows(); ++p)
-    {
-      ret[p].second += pgram(p,f);
-      total_mass += pgram(p,f);
-    }
- 
-  // Normalize by total mass to produce posterior.
-  for(unsigned int i = 0; i < ret.size(); ++i)
-    ret[i].second = ret[i].second / total_mass;
-
-  std::sort(ret.begin(), ret.end(), CompareIndexMassPair);
-  return ret;
+  PosteriorgramStatistics statistics;
+  statistics.Reset(pgram.NumRows(), false);
+  statistics.Accumulate(pgram);
+  return statistics.SortedMass();
 }
 
 } // end namespace statistics
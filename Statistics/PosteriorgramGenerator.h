@@ -8,14 +8,31 @@
 #include<vector>
 #include<utility>
 #include<algorithm>
+#include<limits>
+#include<functional>
+#include<cmath>
+#include<thread>
+#include<atomic>
 #include "MixtureOfDiagonalGaussians.h"
+#include "PackedMixtureSet.h"
 #include "Matrix.h"
+#include "MatrixFunctions.h"
+#include "LogMath.h"
 
 // Stores a vector of mixtures of diagonal Gaussians. Each mixture is
 // associated with an index so multiple mixtures can contribute to the same
 // posterior. Once the GMMs have been set, the class accepts a Matrix of data
 // (feature x frame). The data can be used to produce a posteriorgram, the best
 // index per frame, or a ranked list of outputs for the entire utterance.
+//
+// The Gaussians are scored for a block of frames at once. The quadratic form of
+// a diagonal Gaussian expands to
+//   log N(x) = c + sum_d x_d * (mu_d / var_d) + x_d^2 * (-1 / (2 * var_d))
+// so scoring every frame against every component is a single matrix product
+// of the frames as [x, x^2] with the packed component parameters, followed by
+// a log-sum-exp over the components of each mixture. When PackedMixtureSet has
+// a kernel specialized for the feature dimension, blocks of frames are instead
+// scored directly against the packed components, which is faster.
 
 namespace statistics
 {
@@ -25,9 +42,66 @@ class PosteriorgramGenerator
  private:
   std::vector<MixtureOfDiagonalGaussians> mog_;
   std::vector<int> posterior_index_;
+  unsigned int num_posteriors_;
+  // The mixtures that sum into each posterior, rebuilt by PackGaussians.
+  std::vector<std::vector<unsigned int> > posterior_members_;
+
+  // Every component of mog_ in one contiguous block. Used to score the
+  // shortlisted components directly and to fill the batch parameters below.
+  PackedMixtureSet packed_;
+
+  // Parameters of every component packed for the batch scoring. Column c of
+  // linear_weight_ holds mu/var for the first dimension rows followed by
+  // -1/(2*var) for component c. component_constant_ holds the log weight, the
+  // log normalization constant, and -0.5 * sum(mu^2/var). Components are in
+  // the same order as in packed_.
+  utilities::Matrix<double> linear_weight_;
+  std::vector<double> component_constant_;
+
+  // Gaussian selection. Each row of codebook_ is a codeword placed among the
+  // component means, and shortlist_[k] lists the components evaluated for a
+  // frame whose nearest codeword is k. Every other component is left out of
+  // the mixture sum. The distance to a codeword is scaled per dimension by
+  // codebook_scale_.
+  utilities::Matrix<double> codebook_;
+  std::vector<double> codebook_scale_;
+  std::vector<std::vector<unsigned int> > shortlist_;
+
+  // Fills the packed parameters from mog_.
+  void PackGaussians();
+
+  // Returns the row of codebook_ closest to point.
+  unsigned int NearestCodeword(const double *point) const;
+
+  // Log of the integral of the product of packed components a and b, and of
+  // the weighted sum of those integrals over every pair of components of
+  // mixtures a and b. variance holds the padded variance of each component.
+  double LogProductIntegral(unsigned int a, unsigned int b,
+      const double *variance) const;
+  double LogMixtureProductIntegral(unsigned int a, unsigned int b,
+      const double *variance, std::vector<double> &buffer) const;
+
+  // Writes the mixture log likelihoods of count frames into log_likelihood,
+  // one row of mog_.size() values per frame. Element d of frame f is read
+  // from data[f * frame_stride + d * feature_stride], so the frames can be
+  // either the columns or the rows of a matrix. Only the shortlisted
+  // components are scored if use_selection is true.
+  void FrameScores(const double *data, size_t frame_stride, 
+      size_t feature_stride, unsigned int count, bool use_selection,
+      double *log_likelihood) const;
+
+  // Returns the (mixture x frame) log likelihoods of data, which is
+  // (feature x frame).
+  utilities::Matrix<double> LogLikelihoods(
+      const utilities::Matrix<double> &data, bool use_selection) const;
+
+  // Converts a (mixture x frame) matrix of log likelihoods into the
+  // posteriorgram described by ComputePosteriorgram.
+  utilities::Matrix<double> PosteriorgramFromLogLikelihoods(
+      const utilities::Matrix<double> &log_likelihood) const;
 
  public:
-  PosteriorgramGenerator() {}
+  PosteriorgramGenerator() : num_posteriors_(0) {}
   ~PosteriorgramGenerator() {}
 
   // Set the Gaussians used for calculating posteriors. If a vector of indices
@@ -39,18 +113,102 @@ class PosteriorgramGenerator
   bool SetGaussians(std::vector<MixtureOfDiagonalGaussians> mog, 
       std::vector<int> indices);
 
+  // Replaces the mixtures that share a posterior index with a single mixture
+  // holding all of their components, so each posterior is one log-sum-exp
+  // over its components instead of a sum over its mixtures. The weights of a
+  // mixture are scaled by its prior, one value per mixture. Without a prior
+  // every mixture is equally likely, as in the posteriors computed before
+  // merging, and the posteriorgrams only differ by rounding. Afterwards mixture
+  // p is the merged mixture of posterior p, so the log likelihoods and the
+  // similarity matrix are per posterior. Gaussian selection tables that have
+  // been built are carried over to the merged components. Returns false, and
+  // changes nothing, if the prior does not have one positive value per
+  // mixture.
+  bool AggregateClusters(
+      const std::vector<double> &prior = std::vector<double>());
+
   // Compute the similarity matrix based on the Cauchy-Schwarz Divergance
   // measure. (See the MixtureOfDiagonalGaussian code for more information about
   // the technique.) Each element (i,j) computes the divergence between mog_[i]
   // and mog_[j]. The matrix contains value between 0 and 1, where the most
-  // similar are 1. Each diagonal element should have a value of 1.
-  utilities::Matrix<double> ComputeSimilarityMatrix();
+  // similar are 1. Each diagonal element should have a value of 1. The work is
+  // split across threads; 0 uses one thread per core.
+  utilities::Matrix<double> ComputeSimilarityMatrix(unsigned int threads = 0);
+
+  // Number of rows in a posteriorgram, the highest posterior index + 1.
+  unsigned int num_posteriors() const { return num_posteriors_; }
+
+  // Feature dimension of the Gaussians.
+  unsigned int dimension() const { return packed_.dimension(); }
+
+  // The packed parameters used for scoring.
+  const PackedMixtureSet& packed_gaussians() const { return packed_; }
+
+  // Number of mixtures, the rows of the log likelihood matrix.
+  unsigned int num_mixtures() const { return mog_.size(); }
+
+  // Builds the Gaussian selection tables used by every later call to
+  // ComputeLogLikelihoods. The component means are clustered into codewords
+  // with the given number of k-means iterations, and for each codeword the
+  // shortlist components with the highest weighted likelihood at the codeword
+  // are kept. The shortlist size is the speed and accuracy knob: a frame costs
+  // codewords + shortlist component evaluations instead of every component.
+  // A mixture with no shortlisted component for a frame receives the lowest
+  // mixture score among those evaluated in that frame. Returns false if no
+  // Gaussians are set or either size is zero.
+  bool BuildGaussianSelection(unsigned int codewords, unsigned int shortlist,
+      unsigned int iterations = 10);
+
+  // Removes the Gaussian selection tables so every component is scored.
+  void ClearGaussianSelection();
+
+  // True if BuildGaussianSelection has been called since the Gaussians were
+  // last set.
+  bool UsesGaussianSelection() const { return !shortlist_.empty(); }
+
+  // Reports how far the posteriorgram computed with Gaussian selection is from
+  // the one computed with every component on the given data. Returns the mean
+  // absolute posterior difference over every element, and sets max_error to
+  // the largest single difference and one_best_agreement to the fraction of
+  // frames with the same best posterior index.
+  double GaussianSelectionError(const utilities::Matrix<double> &data,
+      double &max_error, double &one_best_agreement) const;
+
+  // Returns a (mixture x frame) matrix with the log likelihood of every mixture
+  // for every frame of data. Assumes the columns in data are frames. Uses the
+  // Gaussian selection tables if they have been built.
+  utilities::Matrix<double> ComputeLogLikelihoods(
+      const utilities::Matrix<double> &data) const;
+
+  // Computes the mixture log likelihoods for count frames stored one after
+  // another, each with dimension() values, as in the rows of a
+  // SpeechFeatures record. log_likelihood is resized to (frame x mixture).
+  void ComputeFrameLogLikelihoods(const double *frames, unsigned int count,
+      utilities::Matrix<double> &log_likelihood) const;
+
+  // Converts the mog_.size() mixture log likelihoods of a single frame into
+  // num_posteriors() posteriors that sum to one.
+  void FramePosteriors(const double *log_likelihood, double *posterior) const;
 
   // Computes the posteriorgram where the rows are posteriors and columns are 
-  // frames. Assumes the columns in data are also frames. 
+  // frames. Assumes the columns in data are also frames. The posteriors are
+  // normalized from the log likelihoods, so a frame far from every Gaussian
+  // does not become NaN.
   utilities::Matrix<double> ComputePosteriorgram(
       const utilities::Matrix<double> &data) const;
 
+  // Same as ComputePosteriorgram, except every element is the log posterior.
+  // Each posterior is computed as a log-sum-exp over its mixtures minus the
+  // log-sum-exp over every mixture in the frame, so a small posterior does not
+  // underflow to -inf. A posterior with no mass, because it has no mixtures or
+  // only zero weight components, is still -inf, as is every element of a frame
+  // where no mixture has mass. Any value below floor is set to floor, so pass a
+  // finite floor if the result must be finite. The result can be passed
+  // directly to the functions in MultiBestPath.
+  utilities::Matrix<double> ComputeLogPosteriorgram(
+      const utilities::Matrix<double> &data,
+      double floor = -std::numeric_limits<double>::infinity()) const;
+
   // Given the posteriorgram, returns the index of the highest scoring posterior
   // in each frame.
   std::vector<int> BestIndexPerFrame(const utilities::Matrix<double> &pgram);
@@ -68,14 +226,6 @@ class PosteriorgramGenerator
   // it was the highest index.
   std::vector<std::pair<int, double> > BestIndexMass(      
        const utilities::Matrix<double> &pgram);
-
-  // Internal function used to sort a vector of pairs properly.
-  static bool CompareIndexCountPair(const std::pair<int, int> &a, 
-      const std::pair<int, int> &b){ return a.second > b.second; }
-  
-  // Internal function used to sort a vector of pairs properly.
-  static bool CompareIndexMassPair(const std::pair<int, double> &a, 
-      const std::pair<int, double> &b){ return a.second > b.second; }
 };
 
 } // end namespace statistics
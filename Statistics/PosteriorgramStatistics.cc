@@ -0,0 +1,109 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#include "PosteriorgramStatistics.h"
+
+namespace statistics
+{
+
+void PosteriorgramStatistics::Reset(unsigned int posteriors, bool use_entropy)
+{
+  posteriors_ = posteriors;
+  use_entropy_ = use_entropy;
+  best_index_.clear();
+  entropy_.clear();
+  best_count_.assign(posteriors_, 0);
+  mass_.assign(posteriors_, 0);
+}
+
+// The mass of every posterior is added while the frame is searched for its
+// best index, so each value is read once. The running masses are small enough
+// to stay in the L1 cache for the whole posteriorgram.
+void PosteriorgramStatistics::AddFrame(const double *posterior, size_t stride)
+{
+  double best_value = -std::numeric_limits<double>::infinity();
+  int best_index = 0;
+  double entropy = 0;
+  double *mass = &mass_[0];
+  if(use_entropy_)
+  {
+    for(unsigned int p = 0; p < posteriors_; ++p, posterior += stride)
+    {
+      double v = *posterior;
+      mass[p] += v;
+      if(v > best_value)
+      {
+        best_value = v;
+        best_index = p;
+      }
+      if(v > 0)
+        entropy -= v * std::log(v);
+    }
+  }
+  else
+  {
+    for(unsigned int p = 0; p < posteriors_; ++p, posterior += stride)
+    {
+      double v = *posterior;
+      mass[p] += v;
+      if(v > best_value)
+      {
+        best_value = v;
+        best_index = p;
+      }
+    }
+  }
+  best_index_.push_back(best_index);
+  entropy_.push_back(entropy);
+  best_count_[best_index]++;
+}
+
+bool PosteriorgramStatistics::Accumulate(const utilities::Matrix<double> &pgram)
+{
+  if(frames() == 0 && posteriors_ != pgram.NumRows())
+    Reset(pgram.NumRows(), use_entropy_);
+  if(pgram.NumRows() != posteriors_)
+    return false;
+  if(posteriors_ == 0)
+    return true;
+  unsigned int count = pgram.NumCols();
+  best_index_.reserve(best_index_.size() + count);
+  entropy_.reserve(entropy_.size() + count);
+  for(unsigned int f = 0; f < count; ++f)
+    AddFrame(pgram.data() + f, count);
+  return true;
+}
+
+void PosteriorgramStatistics::AccumulateFrame(const double *posterior)
+{
+  if(posteriors_ > 0)
+    AddFrame(posterior, 1);
+}
+
+std::vector<std::pair<int, int> > 
+PosteriorgramStatistics::SortedBestCount() const
+{
+  std::vector<std::pair<int, int> > ret(posteriors_);
+  for(unsigned int i = 0; i < ret.size(); ++i)
+    ret[i] = std::make_pair(i, best_count_[i]);
+  std::sort(ret.begin(), ret.end(), [](const std::pair<int, int> &a,
+      const std::pair<int, int> &b) { return a.second > b.second; });
+  return ret;
+}
+
+std::vector<std::pair<int, double> > PosteriorgramStatistics::SortedMass() const
+{
+  std::vector<std::pair<int, double> > ret(posteriors_);
+  double total_mass = 0;
+  for(unsigned int i = 0; i < ret.size(); ++i)
+    total_mass += mass_[i];
+  // Normalize by total mass to produce posterior.
+  for(unsigned int i = 0; i < ret.size(); ++i)
+    ret[i] = std::make_pair(i, mass_[i] / total_mass);
+  std::sort(ret.begin(), ret.end(), [](const std::pair<int, double> &a,
+      const std::pair<int, double> &b) { return a.second > b.second; });
+  return ret;
+}
+
+} // end namespace statistics
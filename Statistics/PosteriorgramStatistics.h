@@ -0,0 +1,81 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef STATISTICS_POSTERIORGRAMSTATISTICS_H_
+#define STATISTICS_POSTERIORGRAMSTATISTICS_H_
+
+#include<vector>
+#include<utility>
+#include<algorithm>
+#include<limits>
+#include<cmath>
+#include "Matrix.h"
+
+// Collects the summary statistics of a posteriorgram in a single pass: the
+// best index of every frame, the number of frames each index was best, the
+// total mass of each index, and the entropy of every frame. The posteriorgram
+// can be given whole or in chunks of frames, such as the output of a
+// PosteriorgramStream, and the statistics cover every frame seen since the
+// last Reset. Every value is read once, where the separate BestIndex functions
+// of PosteriorgramGenerator each read the whole posteriorgram again.
+
+namespace statistics
+{
+
+class PosteriorgramStatistics
+{
+ private:
+  unsigned int posteriors_;
+  bool use_entropy_;
+  std::vector<int> best_index_;   // One per frame.
+  std::vector<double> entropy_;   // One per frame.
+  std::vector<int> best_count_;   // One per posterior index.
+  std::vector<double> mass_;
+
+  // Adds one frame whose posterior p is posterior[p * stride].
+  void AddFrame(const double *posterior, size_t stride);
+
+ public:
+  PosteriorgramStatistics() : posteriors_(0), use_entropy_(true) {}
+  ~PosteriorgramStatistics() {}
+
+  // Discards everything and prepares for posteriorgrams with the given number
+  // of rows. The entropy costs a log per element, so it can be skipped when
+  // only the best index and mass are needed, leaving every entropy at zero.
+  void Reset(unsigned int posteriors, bool use_entropy = true);
+
+  // Adds the frames of pgram, a (posterior x frame) matrix of linear
+  // posteriors. If nothing has been added yet, the number of rows is taken
+  // from pgram, keeping the current entropy setting. Returns false if the
+  // number of rows does not match.
+  bool Accumulate(const utilities::Matrix<double> &pgram);
+
+  // Adds one frame of posteriors() values.
+  void AccumulateFrame(const double *posterior);
+  void AccumulateFrame(const std::vector<double> &posterior) {
+      AccumulateFrame(&posterior[0]); }
+
+  unsigned int posteriors() const { return posteriors_; }
+  unsigned int frames() const { return best_index_.size(); }
+
+  // Index of the highest posterior in each frame. Ties go to the lowest index.
+  const std::vector<int>& best_index() const { return best_index_; }
+  // Entropy, in nats, of the posteriors of each frame.
+  const std::vector<double>& entropy() const { return entropy_; }
+  // Number of frames in which each index had the highest posterior.
+  const std::vector<int>& best_count() const { return best_count_; }
+  // Sum of each posterior over every frame.
+  const std::vector<double>& mass() const { return mass_; }
+
+  // Pairs of (index, frames where it was best), sorted by the count in
+  // descending order. Matches PosteriorgramGenerator::BestIndexCount.
+  std::vector<std::pair<int, int> > SortedBestCount() const;
+
+  // Pairs of (index, fraction of the total mass), sorted in descending order.
+  // Matches PosteriorgramGenerator::BestIndexMass.
+  std::vector<std::pair<int, double> > SortedMass() const;
+};
+
+} // end namespace statistics
+#endif
@@ -0,0 +1,113 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#include "PosteriorgramStream.h"
+
+namespace statistics
+{
+
+bool PosteriorgramStream::Initialize(const PosteriorgramGenerator *generator,
+    unsigned int block_size)
+{
+  if(generator == 0 || generator->num_mixtures() == 0 || block_size == 0)
+    return false;
+  generator_ = generator;
+  block_size_ = block_size;
+  pending_.resize(static_cast<size_t>(block_size_) * generator_->dimension());
+  Reset();
+  return true;
+}
+
+void PosteriorgramStream::Reset()
+{
+  pending_frames_ = 0;
+  ready_.clear();
+  ready_start_ = 0;
+  ready_frames_ = 0;
+}
+
+void PosteriorgramStream::PushFrame(const double *frame)
+{
+  unsigned int dimension = generator_->dimension();
+  std::copy(frame, frame + dimension,
+      pending_.begin() + static_cast<size_t>(pending_frames_) * dimension);
+  pending_frames_++;
+  if(pending_frames_ == block_size_)
+    ScorePending();
+}
+
+void PosteriorgramStream::PushFrame(const std::vector<double> &frame)
+{
+  PushFrame(&frame[0]);
+}
+
+bool PosteriorgramStream::PushFrames(const utilities::Matrix<double> &frames)
+{
+  if(frames.NumRows() > 0 && frames.NumCols() != generator_->dimension())
+    return false;
+  for(unsigned int f = 0; f < frames.NumRows(); ++f)
+    PushFrame(frames.data() + static_cast<size_t>(f) * frames.NumCols());
+  return true;
+}
+
+void PosteriorgramStream::Flush()
+{
+  if(pending_frames_ > 0)
+    ScorePending();
+}
+
+// Posteriors that have already been popped are dropped before new ones are
+// appended, so ready_ only grows when the caller stops popping.
+void PosteriorgramStream::ScorePending()
+{
+  unsigned int posteriors = generator_->num_posteriors();
+  unsigned int mixtures = generator_->num_mixtures();
+  if(ready_start_ > 0)
+  {
+    ready_.erase(ready_.begin(),
+        ready_.begin() + static_cast<size_t>(ready_start_) * posteriors);
+    ready_frames_ -= ready_start_;
+    ready_start_ = 0;
+  }
+  generator_->ComputeFrameLogLikelihoods(&pending_[0], pending_frames_,
+      log_likelihood_);
+  ready_.resize(static_cast<size_t>(ready_frames_ + pending_frames_) *
+      posteriors);
+  for(unsigned int f = 0; f < pending_frames_; ++f)
+    generator_->FramePosteriors(
+        log_likelihood_.data() + static_cast<size_t>(f) * mixtures,
+        &ready_[static_cast<size_t>(ready_frames_ + f) * posteriors]);
+  ready_frames_ += pending_frames_;
+  pending_frames_ = 0;
+}
+
+bool PosteriorgramStream::PopPosterior(std::vector<double> &posterior)
+{
+  if(available() == 0)
+    return false;
+  unsigned int posteriors = generator_->num_posteriors();
+  std::vector<double>::const_iterator start = ready_.begin() +
+      static_cast<size_t>(ready_start_) * posteriors;
+  posterior.assign(start, start + posteriors);
+  ready_start_++;
+  return true;
+}
+
+utilities::Matrix<double> PosteriorgramStream::PopPosteriorgram()
+{
+  utilities::Matrix<double> ret;
+  unsigned int posteriors = generator_->num_posteriors();
+  unsigned int frames = available();
+  ret.Initialize(posteriors, frames);
+  for(unsigned int f = 0; f < frames; ++f)
+    for(unsigned int p = 0; p < posteriors; ++p)
+      ret(p, f) = ready_[static_cast<size_t>(ready_start_ + f) * posteriors +
+          p];
+  ready_.clear();
+  ready_start_ = 0;
+  ready_frames_ = 0;
+  return ret;
+}
+
+} // end namespace statistics
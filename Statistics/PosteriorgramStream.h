@@ -0,0 +1,88 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef STATISTICS_POSTERIORGRAMSTREAM_H_
+#define STATISTICS_POSTERIORGRAMSTREAM_H_
+
+#include<vector>
+#include "Matrix.h"
+#include "PosteriorgramGenerator.h"
+
+// Computes a posteriorgram one frame at a time for a live feature front end or
+// a recording too long to hold in memory. Frames are pushed in any number of
+// chunks, in the (frame x feature) layout of a SpeechFeatures record, so no
+// transpose is needed. Once a block of frames has been pushed it is scored and
+// the posterior of each frame can be popped in order. Only one block of frames
+// and the posteriors not yet popped are held at any time.
+
+namespace statistics
+{
+
+class PosteriorgramStream
+{
+ private:
+  // Not owned. Must outlive the stream and not change while it is in use.
+  const PosteriorgramGenerator *generator_;
+  unsigned int block_size_;
+
+  // Frames waiting to be scored, one row of dimension values per frame.
+  std::vector<double> pending_;
+  unsigned int pending_frames_;
+
+  // Scored posteriors, num_posteriors values per frame. The frames before
+  // ready_start_ have already been popped.
+  std::vector<double> ready_;
+  unsigned int ready_start_;
+  unsigned int ready_frames_;
+
+  utilities::Matrix<double> log_likelihood_;
+
+  // Scores the pending frames and appends their posteriors to ready_.
+  void ScorePending();
+
+ public:
+  PosteriorgramStream() : generator_(0), block_size_(0), pending_frames_(0),
+      ready_start_(0), ready_frames_(0) {}
+  ~PosteriorgramStream() {}
+
+  // Attaches the stream to a generator whose Gaussians have been set. Frames
+  // are scored block_size at a time, which bounds both the delay before a
+  // posterior is available and the memory used. Returns false if the
+  // generator has no Gaussians or block_size is zero.
+  bool Initialize(const PosteriorgramGenerator *generator,
+      unsigned int block_size = 64);
+
+  // Discards every pending frame and unread posterior so a new utterance can
+  // be started.
+  void Reset();
+
+  // Adds a single frame of generator->dimension() values.
+  void PushFrame(const double *frame);
+  void PushFrame(const std::vector<double> &frame);
+
+  // Adds every row of frames as a frame. Returns false if the number of
+  // columns does not match the dimension of the Gaussians.
+  bool PushFrames(const utilities::Matrix<double> &frames);
+
+  // Scores any pending frames even though they do not fill a block. Call at
+  // the end of an utterance.
+  void Flush();
+
+  // Number of posteriors that can be popped.
+  unsigned int available() const { return ready_frames_ - ready_start_; }
+
+  // Number of frames pushed but not yet scored.
+  unsigned int pending() const { return pending_frames_; }
+
+  // Copies the posterior of the next frame into posterior and removes it.
+  // Returns false if no posterior is available.
+  bool PopPosterior(std::vector<double> &posterior);
+
+  // Removes every available posterior and returns them as the columns of a
+  // (posterior x frame) matrix, the layout of ComputePosteriorgram.
+  utilities::Matrix<double> PopPosteriorgram();
+};
+
+} // end namespace statistics
+#endif
@@ -0,0 +1,229 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#include "QuantizedPosteriorgram.h"
+
+namespace statistics
+{
+
+// The offset and step of a frame map its smallest value to 0 and its largest
+// to the largest integer that fits in bits.
+bool QuantizedPosteriorgram::Initialize(const utilities::Matrix<double> &data,
+    unsigned int bits, QuantizationType type, double log_floor)
+{
+  if(bits != 8 && bits != 16)
+    return false;
+  frames_ = data.NumCols();
+  rows_ = data.NumRows();
+  bits_ = bits;
+  type_ = type;
+  offset_.resize(frames_);
+  step_.resize(frames_);
+  value8_.clear();
+  value16_.clear();
+  if(bits_ == 8)
+    value8_.resize(static_cast<size_t>(frames_) * rows_);
+  else
+    value16_.resize(static_cast<size_t>(frames_) * rows_);
+  double levels = (bits_ == 8) ? 255 : 65535;
+
+  std::vector<double> column(rows_);
+  for(unsigned int f = 0; f < frames_ && rows_ > 0; ++f)
+  {
+    for(unsigned int r = 0; r < rows_; ++r)
+    {
+      column[r] = data(r, f);
+      if(type_ == LOG_QUANTIZATION)
+        column[r] = (column[r] > 0) ? std::max(std::log(column[r]), log_floor)
+            : log_floor;
+    }
+    double min_value = *std::min_element(column.begin(), column.end());
+    double max_value = *std::max_element(column.begin(), column.end());
+    double step = (max_value - min_value) / levels;
+    offset_[f] = static_cast<float>(min_value);
+    step_[f] = static_cast<float>(step);
+    size_t start = static_cast<size_t>(f) * rows_;
+    for(unsigned int r = 0; r < rows_; ++r)
+    {
+      double q = (step > 0) ? std::floor((column[r] - min_value) / step + 0.5)
+          : 0;
+      q = std::min(std::max(q, 0.0), levels);
+      if(bits_ == 8)
+        value8_[start + r] = static_cast<uint8_t>(q);
+      else
+        value16_[start + r] = static_cast<uint16_t>(q);
+    }
+  }
+  return true;
+}
+
+// The bit width is tested once per frame rather than once per value, leaving
+// a plain loop over contiguous memory for each width.
+void QuantizedPosteriorgram::DequantizeFrame(unsigned int frame,
+    float *out) const
+{
+  float offset = offset_[frame];
+  float step = step_[frame];
+  size_t start = static_cast<size_t>(frame) * rows_;
+  if(bits_ == 8)
+  {
+    const uint8_t *in = &value8_[start];
+    for(unsigned int r = 0; r < rows_; ++r)
+      out[r] = offset + step * in[r];
+  }
+  else
+  {
+    const uint16_t *in = &value16_[start];
+    for(unsigned int r = 0; r < rows_; ++r)
+      out[r] = offset + step * in[r];
+  }
+}
+
+void QuantizedPosteriorgram::LinearFrame(unsigned int frame, float *out) const
+{
+  DequantizeFrame(frame, out);
+  if(type_ == LOG_QUANTIZATION)
+    for(unsigned int r = 0; r < rows_; ++r)
+      out[r] = std::exp(out[r]);
+}
+
+// Dequantizes straight into column so the decoder needs no scratch buffer per
+// frame. The arithmetic is done in float to match DequantizeFrame.
+template<typename T>
+static void LogValues(const T *in, unsigned int rows, float offset,
+    float step, bool log_domain, double floor, double *column)
+{
+  if(log_domain)
+  {
+    for(unsigned int r = 0; r < rows; ++r)
+      column[r] = std::max(static_cast<double>(offset + step * in[r]), floor);
+  }
+  else
+  {
+    for(unsigned int r = 0; r < rows; ++r)
+    {
+      double value = offset + step * in[r];
+      column[r] = (value > 0) ? std::max(std::log(value), floor) : floor;
+    }
+  }
+}
+
+void QuantizedPosteriorgram::LogColumn(unsigned int frame, double floor,
+    double *column) const
+{
+  size_t start = static_cast<size_t>(frame) * rows_;
+  bool log_domain = (type_ == LOG_QUANTIZATION);
+  if(bits_ == 8)
+    LogValues(&value8_[start], rows_, offset_[frame], step_[frame], log_domain,
+        floor, column);
+  else
+    LogValues(&value16_[start], rows_, offset_[frame], step_[frame],
+        log_domain, floor, column);
+}
+
+utilities::Matrix<double> QuantizedPosteriorgram::ToMatrix() const
+{
+  utilities::Matrix<double> ret(rows_, frames_);
+  std::vector<float> values(rows_);
+  for(unsigned int f = 0; f < frames_ && rows_ > 0; ++f)
+  {
+    LinearFrame(f, &values[0]);
+    for(unsigned int r = 0; r < rows_; ++r)
+      ret(r, f) = values[r];
+  }
+  return ret;
+}
+
+bool QuantizedPosteriorgram::Read(const std::string &filename)
+{
+  std::ifstream fin;
+  fin.open(filename.c_str(), std::ios::in|std::ios::binary);
+  if( !fin.is_open() )
+    return false;
+  char magic[4];
+  int32_t header[4];
+  fin.read(magic, 4);
+  fin.read(reinterpret_cast<char*>(header), sizeof(header));
+  if( !fin.good() || std::string(magic, 4) != "QPGM" || header[0] < 0 ||
+      header[1] < 0 || (header[2] != 8 && header[2] != 16) ||
+      (header[3] != LINEAR_QUANTIZATION && header[3] != LOG_QUANTIZATION))
+    return false;
+  // The sizes in the header are checked against the length of the file before
+  // anything is allocated, so a corrupt header cannot request a huge buffer.
+  size_t values = static_cast<size_t>(header[0]) * header[1];
+  size_t expected = 4 + sizeof(header) + 2 * sizeof(float) * header[0] +
+      values * (header[2] / 8);
+  std::streampos position = fin.tellg();
+  fin.seekg(0, std::ios::end);
+  std::streampos length = fin.tellg();
+  fin.seekg(position);
+  if( !fin.good() || length < 0 || static_cast<size_t>(length) != expected )
+    return false;
+  frames_ = header[0];
+  rows_ = header[1];
+  bits_ = header[2];
+  type_ = static_cast<QuantizationType>(header[3]);
+  offset_.resize(frames_);
+  step_.resize(frames_);
+  value8_.clear();
+  value16_.clear();
+  if(frames_ > 0)
+  {
+    fin.read(reinterpret_cast<char*>(&offset_[0]), sizeof(float) * frames_);
+    fin.read(reinterpret_cast<char*>(&step_[0]), sizeof(float) * frames_);
+  }
+  if(values > 0 && bits_ == 8)
+  {
+    value8_.resize(values);
+    fin.read(reinterpret_cast<char*>(&value8_[0]), sizeof(uint8_t) * values);
+  }
+  else if(values > 0)
+  {
+    value16_.resize(values);
+    fin.read(reinterpret_cast<char*>(&value16_[0]),
+        sizeof(uint16_t) * values);
+  }
+  if( fin.fail() )
+  {
+    frames_ = 0;
+    offset_.clear();
+    step_.clear();
+    value8_.clear();
+    value16_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool QuantizedPosteriorgram::Write(const std::string &filename) const
+{
+  std::ofstream fout;
+  fout.open(filename.c_str(), std::ios::out|std::ios::binary);
+  if( !fout.is_open() )
+    return false;
+  int32_t header[4];
+  header[0] = frames_;
+  header[1] = rows_;
+  header[2] = bits_;
+  header[3] = type_;
+  fout.write("QPGM", 4);
+  fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+  if(frames_ > 0)
+  {
+    fout.write(reinterpret_cast<const char*>(&offset_[0]),
+        sizeof(float) * frames_);
+    fout.write(reinterpret_cast<const char*>(&step_[0]),
+        sizeof(float) * frames_);
+  }
+  if(!value8_.empty())
+    fout.write(reinterpret_cast<const char*>(&value8_[0]),
+        sizeof(uint8_t) * value8_.size());
+  if(!value16_.empty())
+    fout.write(reinterpret_cast<const char*>(&value16_[0]),
+        sizeof(uint16_t) * value16_.size());
+  fout.close();
+  return !fout.fail();
+}
+
+} // end namespace statistics
@@ -0,0 +1,88 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef STATISTICS_QUANTIZEDPOSTERIORGRAM_H_
+#define STATISTICS_QUANTIZEDPOSTERIORGRAM_H_
+
+#include<vector>
+#include<string>
+#include<fstream>
+#include<algorithm>
+#include<cmath>
+#include "stdint.h"
+
+#include "Matrix.h"
+
+// Stores a posteriorgram, or any other (feature x frame) data, with every value
+// quantized to 8 or 16 bits. Each frame has its own offset and step, so value =
+// offset + step * q, where q is the stored integer. With LINEAR_QUANTIZATION
+// the values themselves are quantized. With LOG_QUANTIZATION the log of each
+// posterior is quantized after being limited to a floor, which keeps the
+// resolution where the decoders need it. Frames are stored one after another,
+// so dequantizing a frame is a single pass over contiguous memory.
+//
+// The file format is the characters "QPGM", then the number of frames, the
+// number of rows, the bits per value, and the quantization type, each a 32 bit
+// integer. The offset and step of every frame follow as 32 bit floats, then the
+// quantized values frame by frame. Everything is written in the byte order of
+// the machine.
+
+namespace statistics
+{
+
+enum QuantizationType {LINEAR_QUANTIZATION, LOG_QUANTIZATION};
+
+class QuantizedPosteriorgram
+{
+ private:
+  unsigned int frames_;
+  unsigned int rows_;
+  unsigned int bits_; // Either 8 or 16.
+  QuantizationType type_;
+  std::vector<float> offset_; // One per frame.
+  std::vector<float> step_;
+  // Only the vector matching bits_ is used. Value r of frame f is at
+  // f * rows_ + r.
+  std::vector<uint8_t> value8_;
+  std::vector<uint16_t> value16_;
+
+ public:
+  QuantizedPosteriorgram() : frames_(0), rows_(0), bits_(8),
+      type_(LINEAR_QUANTIZATION) {}
+  ~QuantizedPosteriorgram() {}
+
+  // Quantizes data, where the columns are frames. For LOG_QUANTIZATION the
+  // data must be linear posteriors, such as the result of
+  // ComputePosteriorgram, and any log posterior below log_floor is stored as
+  // log_floor. Returns false if bits is not 8 or 16.
+  bool Initialize(const utilities::Matrix<double> &data, unsigned int bits,
+      QuantizationType type, double log_floor = -50);
+
+  unsigned int frames() const { return frames_; }
+  unsigned int rows() const { return rows_; }
+  unsigned int bits() const { return bits_; }
+  QuantizationType type() const { return type_; }
+
+  // Writes the rows() stored values of a frame into out. The values are in the
+  // quantized domain, so they are log posteriors for LOG_QUANTIZATION.
+  void DequantizeFrame(unsigned int frame, float *out) const;
+
+  // Writes the rows() values of a frame into out as linear values.
+  void LinearFrame(unsigned int frame, float *out) const;
+
+  // State score kernel for the decoders in MultiBestPath. Fills column with
+  // the log of every value at frame. Values whose log is below floor, including
+  // zeros, receive floor.
+  void LogColumn(unsigned int frame, double floor, double *column) const;
+
+  // Returns the dequantized (row x frame) matrix of linear values.
+  utilities::Matrix<double> ToMatrix() const;
+
+  // Reads or writes the format described above.
+  bool Read(const std::string &filename);
+  bool Write(const std::string &filename) const;
+};
+
+} // end namespace statistics
+#endif
@@ -0,0 +1,182 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#include "SparsePosteriorgram.h"
+
+namespace statistics
+{
+
+bool SparsePosteriorgram::Initialize(const utilities::Matrix<double> &pgram,
+    unsigned int k, bool renormalize)
+{
+  if(k == 0 || k > pgram.NumRows() || pgram.NumRows() > 65536)
+    return false;
+  frames_ = pgram.NumCols();
+  posteriors_ = pgram.NumRows();
+  k_ = k;
+  renormalized_ = renormalize;
+  index_.resize(static_cast<size_t>(frames_) * k_);
+  value_.resize(static_cast<size_t>(frames_) * k_);
+
+  std::vector<std::pair<double, unsigned int> > column(posteriors_);
+  std::vector<unsigned int> kept(k_);
+  for(unsigned int f = 0; f < frames_; ++f)
+  {
+    for(unsigned int p = 0; p < posteriors_; ++p)
+      column[p] = std::make_pair(pgram(p, f), p);
+    std::nth_element(column.begin(), column.begin() + (k_ - 1), column.end(),
+        std::greater<std::pair<double, unsigned int> >());
+    double total = 0;
+    for(unsigned int i = 0; i < k_; ++i)
+    {
+      kept[i] = column[i].second;
+      total += column[i].first;
+    }
+    std::sort(kept.begin(), kept.end());
+    for(unsigned int i = 0; i < k_; ++i)
+    {
+      double value = pgram(kept[i], f);
+      if(renormalize && total > 0)
+        value = value / total;
+      index_[f * k_ + i] = static_cast<uint16_t>(kept[i]);
+      value_[f * k_ + i] = static_cast<float>(value);
+    }
+  }
+  return true;
+}
+
+double SparsePosteriorgram::Posterior(unsigned int p, unsigned int frame) const
+{
+  for(unsigned int i = frame * k_; i < (frame + 1) * k_; ++i)
+    if(index_[i] == p)
+      return value_[i];
+  return 0;
+}
+
+utilities::Matrix<double> SparsePosteriorgram::ToDense() const
+{
+  utilities::Matrix<double> ret(posteriors_, frames_, 0);
+  for(unsigned int f = 0; f < frames_; ++f)
+    for(unsigned int i = f * k_; i < (f + 1) * k_; ++i)
+      ret(index_[i], f) = value_[i];
+  return ret;
+}
+
+void SparsePosteriorgram::LogColumn(unsigned int frame, double floor,
+    double *column) const
+{
+  std::fill(column, column + posteriors_, floor);
+  for(unsigned int i = frame * k_; i < (frame + 1) * k_; ++i)
+    if(value_[i] > 0)
+      column[ index_[i] ] = std::max(std::log(
+          static_cast<double>(value_[i])), floor);
+}
+
+// Both frames are sorted by index, so the common entries are found by walking
+// the two lists together.
+double SparsePosteriorgram::Dot(unsigned int one_frame,
+    const SparsePosteriorgram &two, unsigned int two_frame) const
+{
+  double ret = 0;
+  unsigned int i = one_frame * k_, i_end = (one_frame + 1) * k_;
+  unsigned int j = two_frame * two.k_, j_end = (two_frame + 1) * two.k_;
+  while(i < i_end && j < j_end)
+  {
+    if(index_[i] < two.index_[j])
+      ++i;
+    else if(index_[i] > two.index_[j])
+      ++j;
+    else
+      ret += static_cast<double>(value_[i++]) * two.value_[j++];
+  }
+  return ret;
+}
+
+double SparsePosteriorgram::Norm(unsigned int frame) const
+{
+  double ret = 0;
+  for(unsigned int i = frame * k_; i < (frame + 1) * k_; ++i)
+    ret += static_cast<double>(value_[i]) * value_[i];
+  return std::sqrt(ret);
+}
+
+bool SparsePosteriorgram::Read(const std::string &filename)
+{
+  std::ifstream fin;
+  fin.open(filename.c_str(), std::ios::in|std::ios::binary);
+  if( !fin.is_open() )
+    return false;
+  char magic[4];
+  int32_t header[4];
+  fin.read(magic, 4);
+  fin.read(reinterpret_cast<char*>(header), sizeof(header));
+  if( !fin.good() || std::string(magic, 4) != "SPGM" || header[0] < 0 ||
+      header[1] < 1 || header[1] > 65536 || header[2] < 1 ||
+      header[2] > header[1])
+    return false;
+  // As in QuantizedPosteriorgram::Read, the header is checked against the
+  // length of the file before anything is allocated.
+  size_t entries = static_cast<size_t>(header[0]) * header[2];
+  size_t expected = 4 + sizeof(header) +
+      entries * (sizeof(uint16_t) + sizeof(float));
+  std::streampos position = fin.tellg();
+  fin.seekg(0, std::ios::end);
+  std::streampos length = fin.tellg();
+  fin.seekg(position);
+  if( !fin.good() || length < 0 || static_cast<size_t>(length) != expected )
+    return false;
+  frames_ = header[0];
+  posteriors_ = header[1];
+  k_ = header[2];
+  renormalized_ = (header[3] == 1);
+  index_.resize(static_cast<size_t>(frames_) * k_);
+  value_.resize(static_cast<size_t>(frames_) * k_);
+  for(unsigned int f = 0; f < frames_; ++f)
+  {
+    fin.read(reinterpret_cast<char*>(&index_[f * k_]), sizeof(uint16_t) * k_);
+    fin.read(reinterpret_cast<char*>(&value_[f * k_]), sizeof(float) * k_);
+  }
+  // Every index must name a posterior, and the indices of a frame must be
+  // strictly increasing as Initialize writes them, since ToDense and LogColumn
+  // write through them and Dot merges them.
+  bool valid = !fin.fail();
+  for(unsigned int f = 0; f < frames_ && valid; ++f)
+    for(unsigned int i = f * k_; i < (f + 1) * k_ && valid; ++i)
+      valid = index_[i] < posteriors_ && (i == f * k_ ||
+          index_[i - 1] < index_[i]);
+  if( !valid )
+  {
+    frames_ = 0;
+    index_.clear();
+    value_.clear();
+    return false;
+  }
+  return true;
+}
+
+bool SparsePosteriorgram::Write(const std::string &filename) const
+{
+  std::ofstream fout;
+  fout.open(filename.c_str(), std::ios::out|std::ios::binary);
+  if( !fout.is_open() )
+    return false;
+  int32_t header[4];
+  header[0] = frames_;
+  header[1] = posteriors_;
+  header[2] = k_;
+  header[3] = renormalized_ ? 1 : 0;
+  fout.write("SPGM", 4);
+  fout.write(reinterpret_cast<const char*>(header), sizeof(header));
+  for(unsigned int f = 0; f < frames_; ++f)
+  {
+    fout.write(reinterpret_cast<const char*>(&index_[f * k_]),
+        sizeof(uint16_t) * k_);
+    fout.write(reinterpret_cast<const char*>(&value_[f * k_]),
+        sizeof(float) * k_);
+  }
+  fout.close();
+  return !fout.fail();
+}
+
+} // end namespace statistics
@@ -0,0 +1,94 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef STATISTICS_SPARSEPOSTERIORGRAM_H_
+#define STATISTICS_SPARSEPOSTERIORGRAM_H_
+
+#include<vector>
+#include<string>
+#include<fstream>
+#include<algorithm>
+#include<utility>
+#include<functional>
+#include<cmath>
+#include "stdint.h"
+
+#include "Matrix.h"
+
+// Stores only the k largest posteriors of each frame of a posteriorgram. After
+// normalization nearly all of the mass of a frame sits in a few indices, so
+// keeping a 2 byte index and a 4 byte value for each of them is far smaller
+// than the dense (posterior x frame) matrix. Within a frame the entries are
+// sorted by posterior index so two frames can be compared with a single merge.
+// Every posterior that is not stored is treated as zero.
+//
+// The file format is a 20 byte header followed by the entries. The header is
+// the characters "SPGM", then the number of frames, the number of posteriors,
+// k, and a flag set to 1 if the frames were renormalized, each a 32 bit
+// integer. Each frame is then k 16 bit indices followed by k 32 bit floats.
+// Everything is written in the byte order of the machine.
+
+namespace statistics
+{
+
+class SparsePosteriorgram
+{
+ private:
+  unsigned int frames_;
+  unsigned int posteriors_; // Number of rows in the dense posteriorgram.
+  unsigned int k_; // Entries kept per frame.
+  bool renormalized_;
+  std::vector<uint16_t> index_; // Entry i of frame f is at f * k_ + i.
+  std::vector<float> value_;
+
+ public:
+  SparsePosteriorgram() : frames_(0), posteriors_(0), k_(0),
+      renormalized_(false) {}
+  ~SparsePosteriorgram() {}
+
+  // Keeps the k largest posteriors of each column of pgram, a (posterior x
+  // frame) matrix such as the result of ComputePosteriorgram. If renormalize
+  // is true, the kept values of each frame are scaled to sum to one. Returns
+  // false if k is zero or larger than the number of posteriors, or if there
+  // are more posteriors than a 16 bit index can hold.
+  bool Initialize(const utilities::Matrix<double> &pgram, unsigned int k,
+      bool renormalize);
+
+  unsigned int frames() const { return frames_; }
+  unsigned int posteriors() const { return posteriors_; }
+  unsigned int k() const { return k_; }
+  bool renormalized() const { return renormalized_; }
+
+  // Access to the i-th stored entry of a frame, 0 <= i < k.
+  unsigned int index(unsigned int frame, unsigned int i) const {
+      return index_[frame * k_ + i]; }
+  double value(unsigned int frame, unsigned int i) const {
+      return value_[frame * k_ + i]; }
+
+  // Returns the posterior of row p at frame. Returns zero if p is not stored.
+  double Posterior(unsigned int p, unsigned int frame) const;
+
+  // Returns the (posterior x frame) posteriorgram with zeros for every
+  // posterior that is not stored.
+  utilities::Matrix<double> ToDense() const;
+
+  // State score kernel for the decoders in MultiBestPath. Fills column with
+  // the log posterior of every row at frame. Rows that are not stored, or
+  // whose log is below floor, receive floor.
+  void LogColumn(unsigned int frame, double floor, double *column) const;
+
+  // Distance kernels for DynamicTimeWarp. Dot returns the inner product of
+  // frame one_frame with frame two_frame of two. Norm returns the Euclidean
+  // norm of a frame.
+  double Dot(unsigned int one_frame, const SparsePosteriorgram &two,
+      unsigned int two_frame) const;
+  double Norm(unsigned int frame) const;
+
+  // Reads or writes the format described above.
+  bool Read(const std::string &filename);
+  bool Write(const std::string &filename) const;
+};
+
+} // end namespace statistics
+#endif
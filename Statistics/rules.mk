@@ -1,9 +1,12 @@
 # Rules for Statistics directory.
 local_dir  := Statistics
 local_relsrc  := DiagonalGaussian.cc HiddenMarkovModel.cc HmmSet.cc \
-	MixtureOfDiagonalGaussians.cc PosteriorgramGenerator.cc
+	MixtureOfDiagonalGaussians.cc MixtureSampler.cc \
+	PackedMixtureSet.cc PosteriorgramGenerator.cc PosteriorgramStatistics.cc \
+	PosteriorgramStream.cc QuantizedPosteriorgram.cc SparsePosteriorgram.cc
 local_src  := $(addprefix $(local_dir)/,$(local_relsrc))
-local_relexec  := test_posteriorgram
+local_relexec  := CompileHmmSet CompressHmmSet ExtractPosteriorgrams \
+	test_posteriorgram
 local_exec  := $(addprefix $(local_dir)/,$(local_relexec))
 
 SRCS += $(local_src)
@@ -1,12 +1,35 @@
 #include<iostream>
 #include<string>
 #include<vector>
+#include<new>
+#include<cstdlib>
 #include "PosteriorgramGenerator.h"
+#include "PosteriorgramStream.h"
+#include "PosteriorgramStatistics.h"
+#include "MixtureSampler.h"
 #include "HmmSet.h"
 #include "Matrix.h"
 #include "ImageIO.h"
 #include "SpeechFeatures.h"
 
+// Counts every heap allocation so the pointer based statistics functions can
+// be checked to run without any.
+static unsigned long allocation_count = 0;
+
+void* operator new(std::size_t size)
+{
+  allocation_count++;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if(p == 0)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
 int main()
 {
 
@@ -16,12 +39,94 @@ int main()
   std::string filename("/people/hartmann/research/AASP_CASA/hmm_training/hmm_mfccmvn_cv1/hmm24/hmmdefs");
   htk.LoadHtkHmmSet(filename);                                                   
   
+  // The memory mapped loader should build the same set.
+  statistics::HmmSet mapped;
+  mapped.LoadMappedHtkHmmSet(filename);
+  std::cout<<"Mapped loader matches: "<<(mapped.NumberOfGaussians() == 
+      htk.NumberOfGaussians() && 
+      mapped.mixture_names() == htk.mixture_names())<<std::endl;
+
+  // So should a compiled copy of the set, whose packed parameters are used
+  // from the mapped file.
+  statistics::HmmSet compiled;
+  htk.WriteCompiledHmmSet("hmmdefs.bin");
+  compiled.LoadCompiledHmmSet("hmmdefs.bin");
+  std::cout<<"Compiled set matches: "<<(compiled.NumberOfGaussians() == 
+      htk.NumberOfGaussians() && 
+      compiled.packed_states().log_constant(0) == 
+      htk.packed_states().log_constant(0) &&
+      compiled.mixture_names() == htk.mixture_names())<<std::endl;
+
   std::vector<statistics::MixtureOfDiagonalGaussians> mog = htk.states();        
   std::vector<std::vector<std::string> > names = htk.mixture_names();
   utilities::Matrix<double> similarity_matrix, pgram;
   statistics::PosteriorgramGenerator pg;
   pg.SetGaussians(mog);
   similarity_matrix = pg.ComputeSimilarityMatrix();
+
+  // The Gaussian and mixture functions that take pointers or const references
+  // should not allocate.
+  const statistics::DiagonalGaussian &gaussian = mog[0].gaussian(0);
+  std::vector<double> point = gaussian.mean();
+  statistics::DiagonalGaussian copy = mog[1].gaussian(0);
+  double total = 0;
+  unsigned long allocations = allocation_count;
+  for(unsigned int m = 0; m < mog.size(); ++m)
+  {
+    total += mog[m].LogLikelihood(&point[0]) + mog[m].Likelihood(point);
+    total += mog[m].CSDivergence(mog[0]);
+    total += mog[m].gaussian(0).SymmetricKLDivergence(gaussian);
+    copy.Initialize(mog[m].gaussian(0).mean_data(),
+        mog[m].gaussian(0).variance_data(), gaussian.dimension());
+    copy.AddVariance(gaussian.variance_data());
+  }
+  std::cout<<"Allocations in statistics loop: "<<
+      (allocation_count - allocations)<<" ("<<total<<")"<<std::endl;
+
+  // A component with a weight of zero, as HTK can write, should not turn the
+  // log likelihood into NaN.
+  statistics::MixtureOfDiagonalGaussians zero_weight;
+  zero_weight.AddGaussian(mog[0].gaussian(0), 0.0);
+  zero_weight.AddGaussian(mog[0].gaussian(1), 1.0);
+  statistics::MixtureOfDiagonalGaussians leading_zeros;
+  leading_zeros.AddGaussian(mog[0].gaussian(0), 0.0);
+  leading_zeros.AddGaussian(mog[0].gaussian(1), 0.0);
+  leading_zeros.AddGaussian(mog[1].gaussian(0), 1.0);
+  statistics::PackedMixtureSet packed_zeros;
+  packed_zeros.Initialize(
+      std::vector<statistics::MixtureOfDiagonalGaussians>(1, leading_zeros));
+  std::vector<double> padded(packed_zeros.padded_dimension());
+  packed_zeros.PadPoint(&point[0], &padded[0]);
+  std::cout<<"Zero weight log likelihood: "<<zero_weight.LogLikelihood(point)<<
+      " "<<std::log(zero_weight.Likelihood(point))<<" "<<
+      leading_zeros.LogLikelihood(point)<<" "<<
+      packed_zeros.MixtureLogLikelihood(0, &padded[0])<<std::endl;
+
+  // The mean of many frames from the batch sampler should approach the
+  // weighted mean of the mixture.
+  statistics::MixtureSampler sampler;
+  sampler.Initialize(mog);
+  std::default_random_engine generator;
+  utilities::Matrix<double> samples;
+  sampler.Sample(0, 100000, generator, samples);
+  std::vector<double> weighted_mean = mog[0].WeightedMean();
+  double sample_error = 0;
+  for(unsigned int d = 0; d < samples.NumRows(); ++d)
+  {
+    double sum = 0;
+    for(unsigned int f = 0; f < samples.NumCols(); ++f)
+      sum += samples(d, f);
+    sample_error = std::max(sample_error, 
+        std::abs(sum / samples.NumCols() - weighted_mean[d]));
+  }
+  std::cout<<"Sampled mean max difference: "<<sample_error<<std::endl;
+
+  // The batch symmetric KL matrix over every Gaussian in the set should match
+  // the single pair function.
+  utilities::Matrix<double> kl;
+  htk.packed_states().SymmetricKLDivergences(kl);
+  std::cout<<"Symmetric KL of Gaussians 0 and 1: "<<kl(0, 1)<<" "<<
+      mog[0].gaussian(0).SymmetricKLDivergence(mog[0].gaussian(1))<<std::endl;
   fileutilities::WriteBinaryPGM(similarity_matrix.GetVectorOfVectors(), 
       std::string("simmx.pgm") );
 
@@ -32,6 +137,67 @@ int main()
   data.Transpose();
   pgram = pg.ComputePosteriorgram(data);
   std::vector<int> one_best = pg.BestIndexPerFrame(pgram);
+
+  // Merging the mixtures of each posterior should leave the posteriorgram
+  // unchanged.
+  std::vector<int> groups(mog.size());
+  for(unsigned int i = 0; i < groups.size(); ++i)
+    groups[i] = i / 3;
+  statistics::PosteriorgramGenerator grouped, aggregated;
+  grouped.SetGaussians(mog, groups);
+  aggregated.SetGaussians(mog, groups);
+  aggregated.AggregateClusters();
+  utilities::Matrix<double> grouped_pgram = grouped.ComputePosteriorgram(data);
+  utilities::Matrix<double> aggregated_pgram = 
+      aggregated.ComputePosteriorgram(data);
+  double aggregate_error = 0;
+  for(unsigned int p = 0; p < grouped_pgram.NumRows(); ++p)
+    for(unsigned int f = 0; f < grouped_pgram.NumCols(); ++f)
+      aggregate_error = std::max(aggregate_error, 
+          std::abs(grouped_pgram(p, f) - aggregated_pgram(p, f)));
+  std::cout<<"Aggregated clusters max difference: "<<aggregate_error<<
+      std::endl;
+
+  // Report the posterior error introduced by Gaussian selection.
+  double max_error, agreement;
+  pg.BuildGaussianSelection(64, 256);
+  double mean_error = pg.GaussianSelectionError(data, max_error, agreement);
+  std::cout<<"Gaussian selection error: "<<mean_error<<" max: "<<max_error<<
+      " one-best agreement: "<<agreement<<std::endl;
+  pg.ClearGaussianSelection();
+
+  // The streaming interface should give the same posteriorgram when the
+  // untransposed frames are pushed in small chunks, and the statistics
+  // gathered frame by frame should match those of the whole posteriorgram.
+  statistics::PosteriorgramStatistics batch_statistics, stream_statistics;
+  batch_statistics.Accumulate(pgram);
+  stream_statistics.Reset(pg.num_posteriors());
+  statistics::PosteriorgramStream stream;
+  stream.Initialize(&pg, 32);
+  utilities::Matrix<double> frames = sf.record(0);
+  std::vector<double> posterior;
+  double stream_error = 0;
+  unsigned int out_frame = 0;
+  for(unsigned int f = 0; f < frames.NumRows(); f += 10)
+  {
+    stream.PushFrames(sf.frames(0, f, std::min(f + 10, frames.NumRows()) - 1));
+    if(f + 10 >= frames.NumRows())
+      stream.Flush();
+    while(stream.PopPosterior(posterior))
+    {
+      for(unsigned int p = 0; p < posterior.size(); ++p)
+        stream_error = std::max(stream_error, 
+            std::abs(posterior[p] - pgram(p, out_frame)));
+      stream_statistics.AccumulateFrame(posterior);
+      out_frame++;
+    }
+  }
+  std::cout<<"Streaming frames: "<<out_frame<<" max difference: "<<
+      stream_error<<std::endl;
+  std::cout<<"Streaming statistics match: "<<
+      (stream_statistics.best_index() == one_best && 
+      stream_statistics.best_count() == batch_statistics.best_count())<<
+      std::endl;
   //for( unsigned int i = 0; i < one_best.size(); ++i)
   //  std::cout<<one_best[i]<<" ";
   //std::cout<<std::endl;
@@ -0,0 +1,81 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef UTILITIES_ALIGNEDARRAY_H_
+#define UTILITIES_ALIGNEDARRAY_H_
+
+#include<vector>
+#include<algorithm>
+#include<cstddef>
+#include "stdint.h"
+
+namespace utilities
+{
+
+// A fixed size array whose first element starts on a 64 byte boundary, the
+// width of a cache line and of the widest vector registers. The storage is a
+// std::vector with a few extra elements, and the array begins at the first
+// aligned element. Copies are aligned again for their own storage.
+template <class T>
+class AlignedArray
+{
+ private:
+  std::vector<T> storage_;
+  size_t offset_; // Index of the first aligned element in storage_.
+  size_t size_;
+
+  void Align();
+
+ public:
+  AlignedArray() { Initialize(0); }
+  AlignedArray(const AlignedArray<T> &other);
+  AlignedArray<T>& operator=(const AlignedArray<T> &other);
+  ~AlignedArray() {}
+
+  // Discards the contents and holds size copies of value.
+  void Initialize(size_t size, T value = T());
+
+  size_t size() const { return size_; }
+  T* data() { return &storage_[offset_]; }
+  const T* data() const { return &storage_[offset_]; }
+  T& operator[] (size_t i) { return storage_[offset_ + i]; }
+  T operator[] (size_t i) const { return storage_[offset_ + i]; }
+};
+
+template<class T>
+void AlignedArray<T>::Align()
+{
+  size_t alignment = 64;
+  size_t address = reinterpret_cast<uintptr_t>(&storage_[0]);
+  offset_ = ((alignment - (address % alignment)) % alignment) / sizeof(T);
+}
+
+template<class T>
+AlignedArray<T>::AlignedArray(const AlignedArray<T> &other)
+{
+  Initialize(other.size_);
+  std::copy(other.data(), other.data() + other.size_, data());
+}
+
+template<class T>
+AlignedArray<T>& AlignedArray<T>::operator=(const AlignedArray<T> &other)
+{
+  if(this != &other)
+  {
+    Initialize(other.size_);
+    std::copy(other.data(), other.data() + other.size_, data());
+  }
+  return *this;
+}
+
+template<class T>
+void AlignedArray<T>::Initialize(size_t size, T value)
+{
+  storage_.assign(size + (64 / sizeof(T)) + 1, value);
+  size_ = size;
+  Align();
+}
+
+} // end namespace utilities
+#endif
@@ -0,0 +1,41 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#include "LogMath.h"
+
+namespace utilities
+{
+
+double LogAdd(double a, double b)
+{
+  if(a < b)
+    std::swap(a, b);
+  if(std::isinf(a))
+    return a;
+  return a + std::log1p(std::exp(b - a));
+}
+
+double LogSumExp(const double *values, unsigned int length)
+{
+  if(length == 0)
+    return -std::numeric_limits<double>::infinity();
+  double max_value = values[0];
+  for(unsigned int i = 1; i < length; ++i)
+    max_value = values[i] > max_value ? values[i] : max_value;
+  if(std::isinf(max_value))
+    return max_value;
+  double total = 0;
+  for(unsigned int i = 0; i < length; ++i)
+    total += std::exp(values[i] - max_value);
+  return max_value + std::log(total);
+}
+
+double LogSumExp(const std::vector<double> &values)
+{
+  if(values.size() == 0)
+    return -std::numeric_limits<double>::infinity();
+  return LogSumExp(&values[0], values.size());
+}
+
+} // end namespace utilities
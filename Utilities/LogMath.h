@@ -0,0 +1,30 @@
+// William Hartmann (hartmannw@gmail.com)
+// This is free and unencumbered software released into the public domain.
+// See the UNLICENSE file for more information.
+
+#ifndef UTILITIES_LOGMATH_H_
+#define UTILITIES_LOGMATH_H_
+
+#include<cmath>
+#include<vector>
+#include<limits>
+#include<algorithm>
+
+// Functions for adding probabilities that are stored in the log domain. The
+// maximum value is always subtracted before exponentiating so that the result
+// does not underflow when every value is very small.
+
+namespace utilities
+{
+
+// Returns log(exp(a) + exp(b)).
+double LogAdd(double a, double b);
+
+// Returns log(sum(exp(values))). The maximum is found in a first pass and the
+// sum taken in a second. Returns -inf for an empty array, and the maximum
+// itself when it is infinite.
+double LogSumExp(const double *values, unsigned int length);
+double LogSumExp(const std::vector<double> &values);
+
+} // end namespace utilities
+#endif
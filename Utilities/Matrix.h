@@ -43,6 +43,11 @@ class Matrix
   std::vector<T> GetDiagonal() const;
   std::vector<std::vector<T> > GetVectorOfVectors() const;
 
+  // Direct access to the underlying row major storage. Intended for functions
+  // that need to loop over the elements without the cost of operator().
+  const T* data() const { return matrix_.empty() ? 0 : &matrix_[0]; }
+  T* data() { return matrix_.empty() ? 0 : &matrix_[0]; }
+
   bool SetRow(unsigned int row, const std::vector<T> &values);
   bool SetRow(unsigned int row, T value);
   bool SetCol(unsigned int col, const std::vector<T> &values);
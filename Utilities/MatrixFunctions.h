@@ -11,6 +11,7 @@
 #include<string>
 #include<iostream>
 #include<fstream>
+#include<algorithm>
 #include "Matrix.h"
 
 // Utility functions and functions commonly used for matrices. Most functions
@@ -262,6 +263,66 @@ Matrix<T> MatrixProduct(const Matrix<T> &A, const Matrix<T> &B)
   return ret;
 }
 
+// Computes C = A * B directly on the Matrix storage. The loops are ordered so
+// that the innermost loop runs over a contiguous block of columns in both B
+// and C. The columns are processed in blocks so the block of B stays in cache,
+// and four rows of A are handled together so every element loaded from B is
+// used four times. C is resized to A.NumRows() x B.NumCols().
+template <typename T>
+void BlockedMatrixProduct(const Matrix<T> &A, const Matrix<T> &B, 
+    Matrix<T> &C)
+{
+  unsigned int rows = A.NumRows();
+  unsigned int inner = A.NumCols();
+  unsigned int cols = B.NumCols();
+  unsigned int block = 128;
+  C.Initialize(rows, cols, static_cast<T>(0));
+  if(rows == 0 || inner == 0 || cols == 0)
+    return;
+  const T *a = A.data();
+  const T *b = B.data();
+  T *c = C.data();
+  for(unsigned int start = 0; start < cols; start += block)
+  {
+    unsigned int width = std::min(block, cols - start);
+    unsigned int r = 0;
+    for(; r + 4 <= rows; r += 4)
+    {
+      T *c0 = c + (static_cast<size_t>(r) * cols) + start;
+      T *c1 = c0 + cols;
+      T *c2 = c1 + cols;
+      T *c3 = c2 + cols;
+      const T *a0 = a + (static_cast<size_t>(r) * inner);
+      for(unsigned int k = 0; k < inner; ++k)
+      {
+        T a_0 = a0[k], a_1 = a0[inner + k];
+        T a_2 = a0[2 * inner + k], a_3 = a0[3 * inner + k];
+        const T *b_row = b + (static_cast<size_t>(k) * cols) + start;
+        for(unsigned int j = 0; j < width; ++j)
+        {
+          T b_value = b_row[j];
+          c0[j] += a_0 * b_value;
+          c1[j] += a_1 * b_value;
+          c2[j] += a_2 * b_value;
+          c3[j] += a_3 * b_value;
+        }
+      }
+    }
+    for(; r < rows; ++r) // Remaining rows.
+    {
+      T *c_row = c + (static_cast<size_t>(r) * cols) + start;
+      const T *a_row = a + (static_cast<size_t>(r) * inner);
+      for(unsigned int k = 0; k < inner; ++k)
+      {
+        T a_value = a_row[k];
+        const T *b_row = b + (static_cast<size_t>(k) * cols) + start;
+        for(unsigned int j = 0; j < width; ++j)
+          c_row[j] += a_value * b_row[j];
+      }
+    }
+  }
+}
+
 template <typename T>
 std::vector<T> MatrixDiagonal(std::vector<std::vector<T> > &matrix)
 {
@@ -4,6 +4,8 @@
 
 #include "StringFunctions.h"
 
+#include<fstream>
+
 namespace utilities
 {
 
@@ -16,7 +18,10 @@ std::string TrimStringLeft(const std::string& s,
 std::string TrimStringRight(const std::string& s, 
     const std::string& delimiters /*= " \f\n\r\t\v"*/ )
 {
-  return s.substr( s.find_first_not_of( delimiters ) );
+  size_t first = s.find_first_not_of( delimiters );
+  if( first == std::string::npos ) // String is entirely delimiters.
+    return std::string();
+  return s.substr( first );
 }
 
 std::string TrimString(const std::string& s, 
@@ -37,4 +42,19 @@ bool TokenizeString(std::string line, char delimiter,
   return true;
 }
 
+// The last index need not be followed by a newline, since reading stops at the
+// end of the file rather than one value after it.
+bool ReadIndexFile(const std::string &filename, std::vector<int> &indices)
+{
+  indices.clear();
+  std::ifstream fin;
+  fin.open(filename.c_str(), std::ios::in);
+  if( !fin.is_open() )
+    return false;
+  double n;
+  while(fin >> n)
+    indices.push_back(static_cast<int>(n) - 1);
+  return fin.eof();
+}
+
 } // end namespace utilities
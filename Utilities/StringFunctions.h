@@ -45,5 +45,10 @@ std::string TrimString(const std::string& s,
 bool TokenizeString(std::string line, char delimiter, 
     std::vector<std::string> &tokens);
 
+// Reads a file of white space separated one based indices, such as a cluster
+// index, and stores them zero based in indices. Returns false if the file
+// cannot be opened or contains something other than numbers.
+bool ReadIndexFile(const std::string &filename, std::vector<int> &indices);
+
 } // end namespace utilities
 #endif